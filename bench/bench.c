@@ -0,0 +1,276 @@
+#include "pch.h"
+#include "particle.h"
+#include "job.h"
+#include "scenario.h"
+
+#include <stdio.h>
+
+// ------------------------
+// Thread scaling benchmark
+//
+// Runs the same settled pile scene for 1..N worker threads and reports the
+// mean frame time and the speedup relative to the single threaded run.
+// With --deterministic the pool state hash after the last frame must match
+// across all thread counts, otherwise the benchmark fails.
+//
+// With --scenario the canned scenario suite runs instead, once per scenario
+// at the maximum thread count, and reports per particle costs.
+// ------------------------
+
+typedef struct BenchOptions
+{
+    size_t particleCount;
+    int warmupFrames;
+    int frames;
+    uint32_t maxThreads;
+    uint32_t tileCount;     // domain decomposition tiles, 0 solves the whole pool at once
+    bool isDeterministic;
+    uint64_t seed;
+    const char *scenario;   // scenario name or "all", NULL runs the thread scaling benchmark
+    const char *jsonPath;   // scenario results are also written here as JSON
+    int runs;               // scenario runs, the median of each metric is reported
+    const char *baselinePath;       // compare against this baseline, fail on regressions
+    const char *saveBaselinePath;   // store the results as a new baseline
+    double tolerance;       // allowed relative slowdown of gated metrics
+    bool isGenericForces;   // interpret every force list, for comparison with the fused integrate kernels
+    bool isCheckingTiles;   // compare one tiled step of the settled scene against the untiled step
+}BenchOptions;
+
+static ParticleSystem* ConstructScene_(const BenchOptions *options, JobSystem *jobs, uint32_t tileCount)
+{
+    ParticleSystem *system = ConstructParticleSystem(0, 1280, 0, 720);
+    SetJobSystem(system, jobs);
+    SetDomainDecomposition(system, tileCount);
+    SetDeterministic(system, options->isDeterministic);
+    SetForceSpecialization(system, !options->isGenericForces);
+    SeedParticleSystem(system, options->seed);
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+    // Rows start one particle diameter in from the walls
+    const float spacing = 2.0f * PARTICLE_RADIUS;
+    const Rectangle block = { system->boundaryBox.left + (0.5f * spacing), (float)system->boundaryBox.top,
+        (float)(system->boundaryBox.right - system->boundaryBox.left) - (2.0f * spacing),
+        (float)(system->boundaryBox.bottom - system->boundaryBox.top) - (0.5f * spacing) };
+    FillParticleBlock(system, block, options->particleCount, defaultParticleProps.type);
+    return system;
+}
+
+static double RunScene_(const BenchOptions *options, uint32_t threadCount, uint64_t *stateHash)
+{
+    JobSystem *jobs = (threadCount > 1) ? ConstructJobSystem(threadCount) : NULL;
+    ParticleSystem *system = ConstructScene_(options, jobs, options->tileCount);
+
+    const float deltaTime = 1.0f / 60.0f;
+    for (int i = 0; i < options->warmupFrames; i++) { UpdateParticles(system, deltaTime); }
+
+    const double start = GetPlatformTime();
+    for (int i = 0; i < options->frames; i++) { UpdateParticles(system, deltaTime); }
+    const double elapsed = GetPlatformTime() - start;
+    *stateHash = HashParticleState(system);
+
+    DestructParticleSystem(system);
+    if (jobs) { DestructJobSystem(jobs); }
+
+    return elapsed / (double)options->frames;
+}
+
+static double MeasureBorderOverlap_(const ParticleSystem *system, uint32_t tileCount, double *interiorOverlap)
+{
+    // Mean overlap of touching pairs, split by whether a pair lies within one
+    // contact range of a tile border. Quadratic, the check runs only once.
+    const ParticlePool *particles = system->particles_;
+    const float range = 2.0f * PARTICLE_RADIUS;
+    const float left = (float)system->boundaryBox.left;
+    const float tileWidth = (float)(system->boundaryBox.right - system->boundaryBox.left) / (float)tileCount;
+    double overlaps[2] = { 0.0 };
+    size_t counts[2] = { 0 };
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        const Vector2 pi = GetParticlePosition(particles, i);
+        for (size_t j = i + 1; j < particles->activeCount; j++)
+        {
+            const Vector2 pj = GetParticlePosition(particles, j);
+            const float distance = Vector2Distance(pi, pj);
+            if (distance >= range) { continue; }
+
+            // Nearest border between two tiles, the walls do not count
+            const float x = 0.5f * (pi.x + pj.x) - left;
+            const float border = tileWidth * Clamp(roundf(x / tileWidth), 1.0f, (float)(tileCount - 1));
+            const bool isBorder = (tileCount > 1) && (fabsf(x - border) < range);
+            overlaps[isBorder] += range - distance;
+            counts[isBorder]++;
+        }
+    }
+    *interiorOverlap = overlaps[0] / (double)((counts[0] > 0) ? counts[0] : 1);
+    return overlaps[1] / (double)((counts[1] > 0) ? counts[1] : 1);
+}
+
+static int CheckTiles_(const BenchOptions *options)
+{
+    // Two identical settled piles, then one step with and one without tiles.
+    // Tiles solve contacts in a different order, so positions differ a little.
+    // Contacts across a tile border must still be resolved as well as in the
+    // untiled step, otherwise the seams get different contact physics.
+    const uint32_t tileCount = (options->tileCount > 0) ? options->tileCount : 4;
+    const float deltaTime = 1.0f / 60.0f;
+    ParticleSystem *systems[2];
+    for (int s = 0; s < 2; s++)
+    {
+        systems[s] = ConstructScene_(options, NULL, 0);
+        for (int i = 0; i < options->warmupFrames; i++) { UpdateParticles(systems[s], deltaTime); }
+    }
+    PASSERTABORT(HashParticleState(systems[0]) == HashParticleState(systems[1]), LOG_FATAL, "Settled scenes differ");
+
+    SetDomainDecomposition(systems[1], tileCount);
+    for (int s = 0; s < 2; s++) { UpdateParticles(systems[s], deltaTime); }
+
+    double maxDeviation = 0.0;
+    for (size_t i = 0; i < systems[0]->particles_->activeCount; i++)
+    {
+        const double deviation = Vector2Distance(GetParticlePosition(systems[0]->particles_, i),
+            GetParticlePosition(systems[1]->particles_, i)) / PARTICLE_RADIUS;
+        if (deviation > maxDeviation) { maxDeviation = deviation; }
+    }
+    double interior[2], border[2];
+    for (int s = 0; s < 2; s++) { border[s] = MeasureBorderOverlap_(systems[s], tileCount, &interior[s]) / PARTICLE_RADIUS; }
+    printf("Tiled step against untiled step: %u tiles, %zu particles, max deviation %.4f radii\n",
+        tileCount, systems[0]->particles_->activeCount, maxDeviation);
+    printf("%10s %12s %14s\n", "", "interior", "tile borders");
+    printf("%10s %12.5f %14.5f   mean overlap in radii\n", "untiled", interior[0], border[0]);
+    printf("%10s %12.5f %14.5f\n", "tiled", interior[1], border[1]);
+    for (int s = 0; s < 2; s++) { DestructParticleSystem(systems[s]); }
+
+    // Solver order alone moves particles by a small fraction of a radius and
+    // leaves the seams about as resolved as the untiled step
+    const bool isWithinTolerance = (maxDeviation < 0.1) && (border[1] <= (1.25 * border[0]) + 0.0005);
+    if (!isWithinTolerance) { printf("Tiled step deviates from the untiled step\n"); }
+    return isWithinTolerance ? 0 : 1;
+}
+
+static int RunScenarioSuite_(const BenchOptions *options)
+{
+    const ScenarioOptions scenarioOptions = { options->tileCount, options->isDeterministic, options->seed, options->isGenericForces };
+    const Scenario *selected = NULL;
+    if (strcmp(options->scenario, "all") != 0)
+    {
+        selected = FindScenario(options->scenario);
+        if (!selected)
+        {
+            printf("Unknown scenario '%s'. Available:\n", options->scenario);
+            for (size_t s = 0; s < SCENARIO_COUNT; s++) { printf("  %-16s %s\n", scenarios[s].name, scenarios[s].description); }
+            return 1;
+        }
+    }
+
+    JobSystem *jobs = (options->maxThreads > 1) ? ConstructJobSystem(options->maxThreads) : NULL;
+
+    printf("Scenario suite: %d substeps at %.0f Hz, %u domain tiles%s, seed %llu, median of %d runs, %s pool layout, %s kernels%s\n",
+        PARTICLE_SUBSTEPS, SIMULATION_STEP_RATE, options->tileCount, options->isDeterministic ? ", deterministic" : "",
+        (unsigned long long)options->seed, options->runs, particleLayoutName, simdLevelNames[GetSimdKernels()->level],
+        options->isGenericForces ? ", generic forces" : "");
+    PrintScenarioHeader();
+
+    ScenarioResult results[SCENARIO_COUNT];
+    size_t resultCount = 0;
+    for (size_t s = 0; s < SCENARIO_COUNT; s++)
+    {
+        if (selected && selected != &scenarios[s]) { continue; }
+
+        ScenarioResult *runs = (ScenarioResult*)malloc(sizeof(ScenarioResult) * options->runs);
+        PASSERTABORT(runs, LOG_FATAL, "Failed to allocate scenario runs");
+        for (int r = 0; r < options->runs; r++) { runs[r] = RunScenario(&scenarios[s], jobs, &scenarioOptions); }
+        results[resultCount] = MedianScenarioResult(runs, options->runs);
+        free(runs);
+
+        PrintScenarioResult(&results[resultCount]);
+        resultCount++;
+    }
+
+    if (jobs) { DestructJobSystem(jobs); }
+    PrintScenarioMemory(results, resultCount);
+
+    if (options->jsonPath && !WriteScenarioJson(options->jsonPath, results, resultCount, &scenarioOptions)) { return 1; }
+    if (options->saveBaselinePath && !SaveScenarioBaseline(options->saveBaselinePath, results, resultCount)) { return 1; }
+    if (options->baselinePath)
+    {
+        const int regressionCount = CompareScenarioBaseline(options->baselinePath, results, resultCount, options->tolerance);
+        if (regressionCount != 0)
+        {
+            if (regressionCount > 0) { printf("%d metrics regressed or missing from the baseline\n", regressionCount); }
+            return 1;
+        }
+        printf("No regressions\n");
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options = { 6000, 30, 120, GetHardwareThreadCount(), 0, false, PARTICLE_RANDOM_SEED, NULL, NULL, 0, NULL, NULL, 0.10, false, false };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--particles") == 0 && (i + 1) < argc) { options.particleCount = (size_t)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--frames") == 0 && (i + 1) < argc) { options.frames = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--threads") == 0 && (i + 1) < argc) { options.maxThreads = (uint32_t)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--tiles") == 0 && (i + 1) < argc) { options.tileCount = (uint32_t)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--deterministic") == 0) { options.isDeterministic = true; }
+        else if (strcmp(argv[i], "--seed") == 0 && (i + 1) < argc) { options.seed = strtoull(argv[++i], NULL, 0); }
+        else if (strcmp(argv[i], "--scenario") == 0 && (i + 1) < argc) { options.scenario = argv[++i]; }
+        else if (strcmp(argv[i], "--json") == 0 && (i + 1) < argc) { options.jsonPath = argv[++i]; }
+        else if (strcmp(argv[i], "--runs") == 0 && (i + 1) < argc) { options.runs = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--baseline") == 0 && (i + 1) < argc) { options.baselinePath = argv[++i]; }
+        else if (strcmp(argv[i], "--save-baseline") == 0 && (i + 1) < argc) { options.saveBaselinePath = argv[++i]; }
+        else if (strcmp(argv[i], "--tolerance") == 0 && (i + 1) < argc) { options.tolerance = atof(argv[++i]) / 100.0; }
+        else if (strcmp(argv[i], "--generic-forces") == 0) { options.isGenericForces = true; }
+        else if (strcmp(argv[i], "--check-tiles") == 0) { options.isCheckingTiles = true; }
+        else
+        {
+            printf("usage: %s [--particles N] [--frames N] [--threads N] [--tiles N] [--deterministic] [--seed N] [--generic-forces] [--check-tiles]\n"
+                   "       [--scenario NAME|all] [--json PATH] [--runs N] [--baseline PATH] [--save-baseline PATH] [--tolerance PCT]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.particleCount > MAX_PARTICLE_COUNT) { options.particleCount = MAX_PARTICLE_COUNT; }
+    if (options.frames < 1) { options.frames = 1; }
+    if (options.maxThreads < 1) { options.maxThreads = 1; }
+    // Baselines default to the median of five runs, single runs are too noisy to gate on
+    const bool isBaselineRun = options.baselinePath || options.saveBaselinePath;
+    if (isBaselineRun && !options.scenario) { options.scenario = "all"; }
+    if (options.runs < 1) { options.runs = isBaselineRun ? 5 : 1; }
+
+    SetTraceLogLevel(LOG_WARNING);
+    if (options.scenario) { return RunScenarioSuite_(&options); }
+    if (options.isCheckingTiles) { return CheckTiles_(&options); }
+
+    printf("Thread scaling: %zu particles, %d frames, %u hardware threads, %u domain tiles, %s pool layout, %s kernels%s\n",
+        options.particleCount, options.frames, GetHardwareThreadCount(), options.tileCount, particleLayoutName,
+        simdLevelNames[GetSimdKernels()->level], options.isGenericForces ? ", generic forces" : "");
+    printf("%8s %12s %10s %12s %18s\n", "threads", "ms/frame", "speedup", "efficiency", "state hash");
+
+    // Powers of two up to the maximum, then the maximum itself
+    double baseline = 0.0;
+    uint64_t baselineHash = 0;
+    bool isHashMismatch = false;
+    uint32_t threads = 1;
+    for (;;)
+    {
+        uint64_t stateHash;
+        const double frameTime = RunScene_(&options, threads, &stateHash);
+        if (threads == 1) { baseline = frameTime; baselineHash = stateHash; }
+        isHashMismatch |= (stateHash != baselineHash);
+
+        const double speedup = baseline / frameTime;
+        printf("%8u %12.3f %9.2fx %11.1f%%   %016llx\n", threads, frameTime * 1000.0, speedup, (100.0 * speedup) / threads,
+            (unsigned long long)stateHash);
+
+        if (threads == options.maxThreads) { break; }
+        threads = ((threads * 2) < options.maxThreads) ? (threads * 2) : options.maxThreads;
+    }
+
+    if (options.isDeterministic && isHashMismatch)
+    {
+        printf("Deterministic mode: state hash differs between thread counts\n");
+        return 1;
+    }
+    return 0;
+}
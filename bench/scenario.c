@@ -0,0 +1,428 @@
+#include "pch.h"
+#include "scenario.h"
+
+#include "particle.h"
+#include "job.h"
+
+#include <stdio.h>
+
+const Scenario scenarios[SCENARIO_COUNT] = {
+    { "dam_break",       "water column released into an empty box",        0, 240, SetupDamBreak_,       NULL },
+    { "emitter_flood",   "two sweeping emitters filling the pool",          0, 300, SetupEmitterFlood_,   StepEmitterFlood_ },
+    { "settled_pile",    "dense pile resting on the floor",               180, 120, SetupSettledPile_,    NULL },
+    { "attractor_swarm", "weightless cloud orbiting two moving attractors", 0, 240, SetupAttractorSwarm_, StepAttractorSwarm_ },
+    { "max_fill",        "MAX_PARTICLE_COUNT particles in a settling pile", 60, 120, SetupMaxFill_,       NULL },
+};
+
+static void SetupDamBreak_(ParticleSystem *system)
+{
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+
+    // Column a third of the box wide, stacked from the floor
+    const float width = (float)(system->boundaryBox.right - system->boundaryBox.left);
+    const Rectangle block = { (float)system->boundaryBox.left, (float)system->boundaryBox.top,
+        width / 3.0f, (float)(system->boundaryBox.bottom - system->boundaryBox.top) };
+    FillParticleBlock(system, block, 4000, WATER);
+}
+
+static void SetupEmitterFlood_(ParticleSystem *system)
+{
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+}
+
+static void StepEmitterFlood_(ParticleSystem *system, int step)
+{
+    ParticleProps props = defaultParticleProps;
+    props.lifetime = 1.0e6f;
+
+    const float width = (float)(system->boundaryBox.right - system->boundaryBox.left);
+    const float sweep = sinf(0.05f * (float)step);
+    const Vector2 emitters[2] = {
+        { system->boundaryBox.left + (width * (0.3f + (0.2f * sweep))), system->boundaryBox.top + 40.0f },
+        { system->boundaryBox.left + (width * (0.7f - (0.2f * sweep))), system->boundaryBox.top + 40.0f } };
+
+    for (int k = 0; k < 16; k++)
+    {
+        for (int e = 0; e < 2; e++)
+        {
+            if (system->particles_->activeCount >= MAX_PARTICLE_COUNT) { return; }
+
+            props.type = (ParticleType)e;
+            const Vector2 offset = { NextRandomF(&system->randomState), NextRandomF(&system->randomState) };
+            EmitParticle(system, Vector2Add(emitters[e], Vector2Scale(offset, system->emitter.radius)), &props);
+        }
+    }
+}
+
+static void SetupSettledPile_(ParticleSystem *system)
+{
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+
+    const Rectangle block = { (float)system->boundaryBox.left, (float)system->boundaryBox.top,
+        (float)(system->boundaryBox.right - system->boundaryBox.left), (float)(system->boundaryBox.bottom - system->boundaryBox.top) };
+    FillParticleBlock(system, block, 6000, SAND);
+}
+
+static void SetupAttractorSwarm_(ParticleSystem *system)
+{
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_ATTRACT, 0.0f, { 0 }, 2.0e6f });
+    AddForce(system, (Force){ FORCE_ATTRACT, 0.0f, { 0 }, 2.0e6f });
+    StepAttractorSwarm_(system, 0);
+
+    ParticleProps props = defaultParticleProps;
+    props.variance = 0.0f;
+    props.lifetime = 1.0e6f;
+    props.velocity = (Vector2){ 0 };
+
+    const Vector2 center = { 0.5f * (system->boundaryBox.left + system->boundaryBox.right),
+        0.5f * (system->boundaryBox.top + system->boundaryBox.bottom) };
+    const Vector2 extent = { 0.45f * (system->boundaryBox.right - system->boundaryBox.left),
+        0.45f * (system->boundaryBox.bottom - system->boundaryBox.top) };
+    for (size_t i = 0; i < 3000; i++)
+    {
+        const Vector2 offset = { NextRandomF(&system->randomState) * extent.x, NextRandomF(&system->randomState) * extent.y };
+        EmitParticle(system, Vector2Add(center, offset), &props);
+    }
+}
+
+static void StepAttractorSwarm_(ParticleSystem *system, int step)
+{
+    // The two attractors are the last forces and circle the center in opposite phase
+    const Vector2 center = { 0.5f * (system->boundaryBox.left + system->boundaryBox.right),
+        0.5f * (system->boundaryBox.top + system->boundaryBox.bottom) };
+    const float radius = 0.25f * (system->boundaryBox.bottom - system->boundaryBox.top);
+    const float angle = 0.02f * (float)step;
+    const size_t last = GetForceCount(system) - 1;
+
+    SetForcePosition(system, last - 1, Vector2Add(center, (Vector2){ radius * cosf(angle), radius * sinf(angle) }));
+    SetForcePosition(system, last, Vector2Subtract(center, (Vector2){ radius * cosf(angle), radius * sinf(angle) }));
+}
+
+static void SetupMaxFill_(ParticleSystem *system)
+{
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+
+    const Rectangle block = { (float)system->boundaryBox.left, (float)system->boundaryBox.top,
+        (float)(system->boundaryBox.right - system->boundaryBox.left), (float)(system->boundaryBox.bottom - system->boundaryBox.top) };
+    FillParticleBlock(system, block, MAX_PARTICLE_COUNT, WATER);
+}
+
+static int CompareDouble_(const void *a, const void *b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double Median_(double *values, int count)
+{
+    qsort(values, count, sizeof(double), CompareDouble_);
+    return (count % 2) ? values[count / 2] : (0.5 * (values[(count / 2) - 1] + values[count / 2]));
+}
+
+static size_t GetScenarioMetrics_(const ScenarioResult *result, ScenarioMetric *metrics)
+{
+    // p99, contacts and memory are reported but not gated, the tail is too noisy
+    // for a fixed tolerance and the others only change with the scene.
+    size_t count = 0;
+    metrics[count++] = (ScenarioMetric){ "nsPerParticleSubstep", result->nsPerParticleSubstep, 0.0, true };
+    metrics[count++] = (ScenarioMetric){ "p50StepMs", result->p50StepTime * 1000.0, 0.01, true };
+    metrics[count++] = (ScenarioMetric){ "p99StepMs", result->p99StepTime * 1000.0, 0.0, false };
+    metrics[count++] = (ScenarioMetric){ "contactsPerParticle", result->contactsPerParticle, 0.0, false };
+    metrics[count++] = (ScenarioMetric){ "heapOpsPerStep", result->allocationsPerStep + result->reallocationsPerStep, 0.0, false };
+    metrics[count++] = (ScenarioMetric){ "peakKiB", result->memory.totalPeakBytes / 1024.0, 0.0, false };
+
+#if defined(PARTICLE_PROFILE)
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        ScenarioMetric *metric = &metrics[count++];
+        *metric = (ScenarioMetric){ "", result->phaseTimes[p] * 1000.0, 0.05, true };
+        snprintf(metric->name, sizeof(metric->name), "phase.%s", profilePhaseNames[p]);
+        for (char *c = metric->name; *c; c++) { if (*c == ' ') { *c = '_'; } }
+    }
+#endif
+    return count;
+}
+
+void FillParticleBlock(ParticleSystem *system, Rectangle block, size_t count, ParticleType type)
+{
+    // Grid of resting particles jittered from the system's seeded random
+    // stream so neighbours overlap. A zero variance keeps the lifetimes and
+    // velocities fixed.
+    ParticleProps props = defaultParticleProps;
+    props.variance = 0.0f;
+    props.lifetime = 1.0e6f;
+    props.velocity = (Vector2){ 0 };
+    props.type = type;
+
+    const float spacing = 2.0f * PARTICLE_RADIUS;
+    const size_t columns = (block.width > spacing) ? (size_t)(block.width / spacing) : 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vector2 position = {
+            block.x + (0.5f * spacing) + ((i % columns) * spacing),
+            block.y + block.height - (0.5f * spacing) - ((i / columns) * spacing) };
+        const Vector2 jitter = { NextRandomF(&system->randomState), NextRandomF(&system->randomState) };
+        EmitParticle(system, Vector2Add(position, Vector2Scale(jitter, 0.25f * PARTICLE_RADIUS)), &props);
+    }
+}
+
+const Scenario* FindScenario(const char *name)
+{
+    for (size_t s = 0; s < SCENARIO_COUNT; s++)
+    {
+        if (strcmp(scenarios[s].name, name) == 0) { return &scenarios[s]; }
+    }
+    return NULL;
+}
+
+ScenarioResult RunScenario(const Scenario *scenario, JobSystem *jobs, const ScenarioOptions *options)
+{
+    ScenarioResult result = { 0 };
+    result.scenario = scenario;
+    result.threadCount = GetJobThreadCount(jobs);
+    ResetMemoryPeaks();
+
+    ParticleSystem *system = ConstructParticleSystem(0, 1280, 0, 720);
+    SetJobSystem(system, jobs);
+    SetDomainDecomposition(system, options->tileCount);
+    SetDeterministic(system, options->isDeterministic);
+    SetForceSpecialization(system, !options->isGenericForces);
+    SeedParticleSystem(system, options->seed);
+    scenario->SetupFn(system);
+
+    const float deltaTime = 1.0f / SIMULATION_STEP_RATE;
+    int step = 0;
+    for (; step < scenario->warmupSteps; step++)
+    {
+        if (scenario->StepFn) { scenario->StepFn(system, step); }
+        UpdateParticles(system, deltaTime);
+    }
+
+    double *stepTimes = (double*)malloc(sizeof(double) * scenario->steps);
+    PASSERTABORT(stepTimes, LOG_FATAL, "Failed to allocate step timings");
+
+    double elapsed = 0.0;
+    double particleSubsteps = 0.0;
+    double contacts = 0.0;
+    double allocations = 0.0, reallocations = 0.0;
+#if defined(PARTICLE_PROFILE)
+    double phaseTotals[PROFILE_PHASE_COUNT] = { 0 };
+#endif
+    for (int i = 0; i < scenario->steps; i++, step++)
+    {
+        if (scenario->StepFn) { scenario->StepFn(system, step); }
+
+        const double start = GetPlatformTime();
+        UpdateParticles(system, deltaTime);
+        stepTimes[i] = GetPlatformTime() - start;
+
+        elapsed += stepTimes[i];
+        particleSubsteps += (double)system->particles_->activeCount * PARTICLE_SUBSTEPS;
+        contacts += (double)system->stats.contactCount;
+        allocations += (double)system->stats.allocationCount;
+        reallocations += (double)system->stats.reallocationCount;
+#if defined(PARTICLE_PROFILE)
+        for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { phaseTotals[p] += system->stats.phaseTimes[p]; }
+#endif
+    }
+
+    qsort(stepTimes, scenario->steps, sizeof(double), CompareDouble_);
+    result.finalCount = system->particles_->activeCount;
+    result.meanCount = particleSubsteps / ((double)scenario->steps * PARTICLE_SUBSTEPS);
+    result.nsPerParticleSubstep = (particleSubsteps > 0.0) ? ((elapsed * 1.0e9) / particleSubsteps) : 0.0;
+    result.contactsPerParticle = (particleSubsteps > 0.0) ? (contacts / particleSubsteps) : 0.0;
+    result.meanStepTime = elapsed / (double)scenario->steps;
+    result.p50StepTime = stepTimes[scenario->steps / 2];
+    result.p99StepTime = stepTimes[((scenario->steps - 1) * 99) / 100];
+    result.stateHash = HashParticleState(system);
+    result.forceSet = system->stats.forceSet;
+    result.allocationsPerStep = allocations / (double)scenario->steps;
+    result.reallocationsPerStep = reallocations / (double)scenario->steps;
+    result.memory = GetMemoryStats();
+#if defined(PARTICLE_PROFILE)
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { result.phaseTimes[p] = phaseTotals[p] / (double)scenario->steps; }
+#endif
+
+    free(stepTimes);
+    DestructParticleSystem(system);
+    return result;
+}
+
+void PrintScenarioHeader(void)
+{
+    printf("%-16s %8s %10s %14s %12s %10s %10s %10s %10s %10s   %-16s   %s\n", "scenario", "threads", "particles",
+        "ns/part/sub", "contacts/p", "mean ms", "p50 ms", "p99 ms", "heap/step", "peak MiB", "state hash", "forces");
+}
+
+void PrintScenarioResult(const ScenarioResult *result)
+{
+    printf("%-16s %8u %10.0f %14.2f %12.2f %10.3f %10.3f %10.3f %10.2f %10.2f   %016llx   %s\n", result->scenario->name,
+        result->threadCount, result->meanCount, result->nsPerParticleSubstep, result->contactsPerParticle,
+        result->meanStepTime * 1000.0, result->p50StepTime * 1000.0, result->p99StepTime * 1000.0,
+        result->allocationsPerStep + result->reallocationsPerStep, result->memory.totalPeakBytes / (1024.0 * 1024.0), (unsigned long long)result->stateHash,
+        forceSetNames[result->forceSet]);
+}
+
+void PrintScenarioMemory(const ScenarioResult *results, size_t count)
+{
+    // Peak bytes per subsystem, one column per scenario
+    printf("%-12s", "peak KiB");
+    for (size_t r = 0; r < count; r++) { printf(" %16s", results[r].scenario->name); }
+    putchar('\n');
+
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+    {
+        bool isUsed = false;
+        for (size_t r = 0; r < count; r++) { isUsed |= (results[r].memory.peakBytes[t] > 0); }
+        if (!isUsed) { continue; }
+
+        printf("%-12s", memoryTagNames[t]);
+        for (size_t r = 0; r < count; r++) { printf(" %16.1f", results[r].memory.peakBytes[t] / 1024.0); }
+        putchar('\n');
+    }
+}
+
+bool WriteScenarioJson(const char *path, const ScenarioResult *results, size_t count, const ScenarioOptions *options)
+{
+    FILE *file = fopen(path, "w");
+    PASSERTRETURNVALUE(file, false, LOG_ERROR, "Failed to open %s for writing", path);
+
+    fprintf(file, "{\n  \"substeps\": %d,\n  \"stepRate\": %.1f,\n  \"tiles\": %u,\n  \"deterministic\": %s,\n  \"seed\": %llu,\n",
+        PARTICLE_SUBSTEPS, SIMULATION_STEP_RATE, options->tileCount, options->isDeterministic ? "true" : "false",
+        (unsigned long long)options->seed);
+    fprintf(file, "  \"layout\": \"%s\",\n  \"simd\": \"%s\",\n  \"specializedForces\": %s,\n", particleLayoutName,
+        simdLevelNames[GetSimdKernels()->level], options->isGenericForces ? "false" : "true");
+    fprintf(file, "  \"scenarios\": [\n");
+    for (size_t r = 0; r < count; r++)
+    {
+        const ScenarioResult *result = &results[r];
+        fprintf(file, "    { \"name\": \"%s\", \"threads\": %u, \"steps\": %d, \"meanParticles\": %.1f, \"finalParticles\": %zu, "
+            "\"nsPerParticleSubstep\": %.4f, \"contactsPerParticle\": %.4f, "
+            "\"meanStepMs\": %.4f, \"p50StepMs\": %.4f, \"p99StepMs\": %.4f, "
+            "\"allocationsPerStep\": %.2f, \"reallocationsPerStep\": %.2f, \"peakBytes\": %zu, \"stateHash\": \"%016llx\", "
+            "\"forceSet\": \"%s\" }%s\n",
+            result->scenario->name, result->threadCount, result->scenario->steps, result->meanCount, result->finalCount,
+            result->nsPerParticleSubstep, result->contactsPerParticle,
+            result->meanStepTime * 1000.0, result->p50StepTime * 1000.0, result->p99StepTime * 1000.0,
+            result->allocationsPerStep, result->reallocationsPerStep, result->memory.totalPeakBytes,
+            (unsigned long long)result->stateHash, forceSetNames[result->forceSet], ((r + 1) < count) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
+
+ScenarioResult MedianScenarioResult(const ScenarioResult *runs, int runCount)
+{
+    PASSERTRETURNVALUE(runCount > 0, (ScenarioResult){ 0 }, LOG_ERROR, "Median of zero scenario runs");
+
+    ScenarioResult result = runs[0];
+    double *values = (double*)malloc(sizeof(double) * runCount);
+    PASSERTABORT(values, LOG_FATAL, "Failed to allocate scenario medians");
+
+#define MEDIAN_FIELD(field) \
+    for (int r = 0; r < runCount; r++) { values[r] = runs[r].field; } \
+    result.field = Median_(values, runCount)
+
+    MEDIAN_FIELD(nsPerParticleSubstep);
+    MEDIAN_FIELD(contactsPerParticle);
+    MEDIAN_FIELD(meanStepTime);
+    MEDIAN_FIELD(p50StepTime);
+    MEDIAN_FIELD(p99StepTime);
+    MEDIAN_FIELD(allocationsPerStep);
+    MEDIAN_FIELD(reallocationsPerStep);
+#if defined(PARTICLE_PROFILE)
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { MEDIAN_FIELD(phaseTimes[p]); }
+#endif
+#undef MEDIAN_FIELD
+
+    free(values);
+    return result;
+}
+
+bool SaveScenarioBaseline(const char *path, const ScenarioResult *results, size_t count)
+{
+    FILE *file = fopen(path, "w");
+    PASSERTRETURNVALUE(file, false, LOG_ERROR, "Failed to open %s for writing", path);
+
+    fprintf(file, "# scenario metric value, %d substeps at %.0f Hz\n", PARTICLE_SUBSTEPS, SIMULATION_STEP_RATE);
+    for (size_t r = 0; r < count; r++)
+    {
+        ScenarioMetric metrics[MAX_SCENARIO_METRICS];
+        const size_t metricCount = GetScenarioMetrics_(&results[r], metrics);
+        for (size_t m = 0; m < metricCount; m++)
+        {
+            fprintf(file, "%s %s %.6f\n", results[r].scenario->name, metrics[m].name, metrics[m].value);
+        }
+    }
+
+    fclose(file);
+    printf("Saved baseline of %zu scenarios to %s\n", count, path);
+    return true;
+}
+
+int CompareScenarioBaseline(const char *path, const ScenarioResult *results, size_t count, double tolerance)
+{
+    FILE *file = fopen(path, "r");
+    PASSERTRETURNVALUE(file, -1, LOG_ERROR, "Failed to open baseline %s", path);
+
+    BaselineEntry *entries = NULL;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        BaselineEntry entry;
+        if (line[0] == '#') { continue; }
+        if (sscanf(line, "%31s %31s %lf", entry.scenario, entry.metric, &entry.value) == 3) { arrput(entries, entry); }
+    }
+    fclose(file);
+    if (arrlenu(entries) == 0)
+    {
+        TraceLog(LOG_ERROR, "Baseline %s has no entries", path);
+        return -1;
+    }
+
+    printf("Baseline %s, tolerance %.1f%%\n", path, tolerance * 100.0);
+    printf("%-16s %-24s %12s %12s %9s\n", "scenario", "metric", "baseline", "current", "change");
+
+    int regressionCount = 0;
+    for (size_t r = 0; r < count; r++)
+    {
+        ScenarioMetric metrics[MAX_SCENARIO_METRICS];
+        const size_t metricCount = GetScenarioMetrics_(&results[r], metrics);
+        for (size_t m = 0; m < metricCount; m++)
+        {
+            const BaselineEntry *base = NULL;
+            for (size_t e = 0; e < arrlenu(entries) && !base; e++)
+            {
+                if (strcmp(entries[e].scenario, results[r].scenario->name) == 0 && strcmp(entries[e].metric, metrics[m].name) == 0) { base = &entries[e]; }
+            }
+            if (!base)
+            {
+                // A gated metric without a baseline value cannot be checked, which fails
+                // the comparison so a stale or mismatched baseline never passes
+                regressionCount += metrics[m].isGated ? 1 : 0;
+                printf("%-16s %-24s %12s %12.3f %9s%s\n", results[r].scenario->name, metrics[m].name, "-", metrics[m].value, "new",
+                    metrics[m].isGated ? "  MISSING" : "");
+                continue;
+            }
+
+            const double delta = metrics[m].value - base->value;
+            const double change = (base->value > 0.0) ? (delta / base->value) : 0.0;
+            const bool isRegression = metrics[m].isGated && (change > tolerance) && (delta > metrics[m].minDelta);
+            regressionCount += isRegression ? 1 : 0;
+
+            printf("%-16s %-24s %12.3f %12.3f %+8.1f%%%s\n", results[r].scenario->name, metrics[m].name, base->value,
+                metrics[m].value, change * 100.0, isRegression ? "  REGRESSION" : (metrics[m].isGated ? "" : "  (not gated)"));
+        }
+    }
+
+    arrfree(entries);
+    return regressionCount;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "raylib.h"
+#include "particle.h"
+#include "allocator.h"
+
+#define SCENARIO_COUNT 5
+#define MAX_SCENARIO_METRICS (6 + PROFILE_PHASE_COUNT)
+
+// Scenarios
+// -----------------
+// Canned scenes for the benchmark suite. Every scenario builds its scene from
+// the system's seeded random stream and runs UpdateParticles with a fixed step,
+// so two runs with the same options simulate exactly the same work.
+typedef void (*SetupScenarioFn)(ParticleSystem *system);
+typedef void (*StepScenarioFn)(ParticleSystem *system, int step);
+
+typedef struct Scenario
+{
+    const char *name;
+    const char *description;
+    int warmupSteps;            // steps run before timing, e.g. to let a pile settle
+    int steps;                  // timed steps
+    SetupScenarioFn SetupFn;
+    StepScenarioFn StepFn;      // scripted input before every step, may be NULL
+}Scenario;
+
+typedef struct ScenarioOptions
+{
+    uint32_t tileCount;         // domain decomposition tiles, 0 solves the whole pool at once
+    bool isDeterministic;
+    uint64_t seed;
+    bool isGenericForces;       // interpret every force list instead of running the fused integrate kernels
+}ScenarioOptions;
+
+typedef struct ScenarioResult
+{
+    const Scenario *scenario;
+    uint32_t threadCount;
+
+    size_t finalCount;          // active particles after the last step
+    double meanCount;           // active particles averaged over the timed steps
+    double nsPerParticleSubstep;
+    double contactsPerParticle; // collision contacts per particle and substep
+
+    double meanStepTime;        // seconds
+    double p50StepTime;
+    double p99StepTime;
+    uint64_t stateHash;
+    ForceSet forceSet;          // integrate variant of the last step
+
+    double allocationsPerStep;  // heap blocks allocated per timed step
+    double reallocationsPerStep;
+    MemoryStats memory;         // tracked heap while the scenario ran, peaks include setup
+
+#if defined(PARTICLE_PROFILE)
+    double phaseTimes[PROFILE_PHASE_COUNT];   // seconds per step
+#endif
+}ScenarioResult;
+
+// Baselines
+// -----------------
+// A baseline stores named metrics per scenario as plain "scenario metric value"
+// lines. Gated metrics fail the comparison when they grow by more than the
+// tolerance and by more than minDelta, which keeps near-zero phases from
+// failing on timer noise.
+typedef struct ScenarioMetric
+{
+    char name[32];
+    double value;
+    double minDelta;
+    bool isGated;
+}ScenarioMetric;
+
+typedef struct BaselineEntry
+{
+    char scenario[32];
+    char metric[32];
+    double value;
+}BaselineEntry;
+
+// declare extern variables
+// -----------------
+extern const Scenario scenarios[SCENARIO_COUNT];
+
+// Private methods
+// -----------------
+static void SetupDamBreak_(ParticleSystem *system);
+static void SetupEmitterFlood_(ParticleSystem *system);
+static void StepEmitterFlood_(ParticleSystem *system, int step);
+static void SetupSettledPile_(ParticleSystem *system);
+static void SetupAttractorSwarm_(ParticleSystem *system);
+static void StepAttractorSwarm_(ParticleSystem *system, int step);
+static void SetupMaxFill_(ParticleSystem *system);
+static int CompareDouble_(const void *a, const void *b);
+static double Median_(double *values, int count);
+static size_t GetScenarioMetrics_(const ScenarioResult *result, ScenarioMetric *metrics);
+
+// Interface methods
+// -----------------
+const Scenario* FindScenario(const char *name);
+// Emits count resting particles in rows from the bottom of block upwards
+void FillParticleBlock(ParticleSystem *system, Rectangle block, size_t count, ParticleType type);
+ScenarioResult RunScenario(const Scenario *scenario, JobSystem *jobs, const ScenarioOptions *options);
+ScenarioResult MedianScenarioResult(const ScenarioResult *runs, int runCount);
+
+void PrintScenarioHeader(void);
+void PrintScenarioResult(const ScenarioResult *result);
+void PrintScenarioMemory(const ScenarioResult *results, size_t count);
+bool WriteScenarioJson(const char *path, const ScenarioResult *results, size_t count, const ScenarioOptions *options);
+
+bool SaveScenarioBaseline(const char *path, const ScenarioResult *results, size_t count);
+// Returns the number of regressed gated metrics plus the gated metrics the
+// baseline lacks, or -1 when the baseline cannot be read or has no entries
+int CompareScenarioBaseline(const char *path, const ScenarioResult *results, size_t count, double tolerance);
@@ -43,6 +43,27 @@ newoption
     default = "off"
 }
 
+newoption
+{
+    trigger = "profile",
+    description = "Keep the per-phase profiler timers in release builds"
+}
+
+newoption
+{
+    trigger = "layout",
+    value = "PARTICLE_LAYOUT",
+    description = "memory layout of the particle pool",
+    allowed = {
+        { "soa", "One array per attribute, Vector2 attributes interleaved"},
+        { "split", "One array per component"},
+        { "aosoa", "Blocks of 8 particles with split components"}
+    },
+    default = "soa"
+}
+
+particle_layouts = { soa = "PARTICLE_LAYOUT_SOA", split = "PARTICLE_LAYOUT_SPLIT", aosoa = "PARTICLE_LAYOUT_AOSOA" }
+
 function download_progress(total, current)
     local ratio = current / total;
     ratio = math.min(math.max(ratio, 0), 1);
@@ -106,6 +127,15 @@ function platform_defines()
     filter {"system:macosx"}
         disablewarnings {"deprecated-declarations"}
 
+    filter {"options:profile"}
+        defines{"PARTICLE_PROFILE"}
+
+    filter {"options:layout=split"}
+        defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_SPLIT"}
+
+    filter {"options:layout=aosoa"}
+        defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_AOSOA"}
+
     filter {"system:linux", "options:wayland=off"}
         defines {"_GLFW_X11"}
 
@@ -115,6 +145,36 @@ function platform_defines()
     filter {}
 end
 
+function link_raylib()
+    links {"raylib"}
+
+    filter "action:vs*"
+        defines{"_WINSOCK_DEPRECATED_NO_WARNINGS", "_CRT_SECURE_NO_WARNINGS"}
+        dependson {"raylib"}
+        links {"raylib.lib"}
+        characterset ("Unicode")
+        buildoptions { "/Zc:__cplusplus", "/experimental:c11atomics" }
+
+    filter "system:windows"
+        defines{"_WIN32"}
+        links {"winmm", "gdi32", "opengl32"}
+        libdirs {"../bin/%{cfg.buildcfg}"}
+
+    filter "system:linux"
+        links {"pthread", "m", "dl", "rt"}
+
+    filter {"system:linux", "options:wayland=off"}
+        links {"X11"}
+
+    filter {"system:linux", "options:wayland=on"}
+        links {"wayland-client", "wayland-cursor", "wayland-egl", "xkbcommon"}
+
+    filter "system:macosx"
+        links {"OpenGL.framework", "Cocoa.framework", "IOKit.framework", "CoreFoundation.framework", "CoreAudio.framework", "CoreVideo.framework", "AudioToolbox.framework"}
+
+    filter {}
+end
+
 -- if you don't want to download raylib, then set this to false, and set the raylib dir to where you want raylib to be pulled from, must be full sources.
 downloadRaylib = true
 raylib_dir = "external/raylib-master"
@@ -208,8 +268,6 @@ if (downloadRaylib) then
         includedirs { "../src" }
         includedirs { "../include" }
 
-        links {"raylib"}
-        
         language "C"
         cdialect "C17"
 
@@ -217,33 +275,145 @@ if (downloadRaylib) then
 
         flags { "ShadowedVariables"}
         platform_defines()
+        link_raylib()
+
+    project "benchmark"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
 
         filter "action:vs*"
-            defines{"_WINSOCK_DEPRECATED_NO_WARNINGS", "_CRT_SECURE_NO_WARNINGS"}
-            dependson {"raylib"}
-            links {"raylib.lib"}
-            characterset ("Unicode")
-            buildoptions { "/Zc:__cplusplus" }
+            debugdir "$(SolutionDir)"
+        filter{}
 
-        filter "system:windows"
-            defines{"_WIN32"}
-            links {"winmm", "gdi32", "opengl32"}
-            libdirs {"../bin/%{cfg.buildcfg}"}
+        vpaths 
+        {
+            ["Header Files/*"] = { "../bench/**.h", "../src/**.h" },
+            ["Source Files/*"] = { "../bench/**.c", "../src/**.c" },
+        }
+
+        -- Simulation sources without the game entry point
+        files {"../bench/**.c", "../bench/**.h", "../src/**.c", "../src/**.h"}
+        removefiles {"../src/main.c"}
+
+        includedirs { "../src", "../include", "../bench" }
+
+        language "C"
+        cdialect "C17"
+
+        includedirs {raylib_dir .. "/src" }
+
+        flags { "ShadowedVariables"}
+        platform_defines()
+        link_raylib()
+
+    project "headless"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
+
+        filter "action:vs*"
+            debugdir "$(SolutionDir)"
+            defines{"_CRT_SECURE_NO_WARNINGS"}
+        filter{}
+
+        vpaths 
+        {
+            ["Header Files/*"] = { "../src/**.h" },
+            ["Source Files/*"] = { "../headless/**.c", "../src/**.c" },
+        }
+
+        -- Simulation core only, no window, renderer or raylib runtime
+        files {"../headless/**.c"}
+        files {
+            "../src/pch.c", "../src/allocator.c", "../src/platform.c", "../src/job.c", "../src/hash.c",
+            "../src/collider.c", "../src/sdf.c", "../src/domain.c", "../src/particle.c", "../src/profiler.c", "../src/trace.c",
+            "../src/simd.c",
+        }
+        defines {"PARTICLE_HEADLESS"}
+
+        filter {"options:profile"}
+            defines{"PARTICLE_PROFILE"}
+        filter {"options:layout=split"}
+            defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_SPLIT"}
+        filter {"options:layout=aosoa"}
+            defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_AOSOA"}
+        filter{}
+
+        includedirs { "../src", "../include" }
+
+        language "C"
+        cdialect "C17"
+
+        -- raylib headers only, for the math types and raymath
+        includedirs {raylib_dir .. "/src" }
+
+        flags { "ShadowedVariables"}
 
         filter "system:linux"
-            links {"pthread", "m", "dl", "rt"}
+            links {"pthread", "m"}
+        filter{}
+
+    -- Builds the microbenchmark once with the --layout pool layout and once
+    -- per layout, so all three can be compared from a single build.
+    function microbench_project(name, layout)
+    project (name)
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
 
-        filter {"system:linux", "options:wayland=off"}
-            links {"X11"}
+        filter "action:vs*"
+            debugdir "$(SolutionDir)"
+            defines{"_CRT_SECURE_NO_WARNINGS"}
+        filter{}
 
-        filter {"system:linux", "options:wayland=on"}
-            links {"wayland-client", "wayland-cursor", "wayland-egl", "xkbcommon"}
+        vpaths 
+        {
+            ["Header Files/*"] = { "../src/**.h" },
+            ["Source Files/*"] = { "../microbench/**.c", "../headless/**.c", "../src/**.c" },
+        }
 
-        filter "system:macosx"
-            links {"OpenGL.framework", "Cocoa.framework", "IOKit.framework", "CoreFoundation.framework", "CoreAudio.framework", "CoreVideo.framework", "AudioToolbox.framework"}
+        -- particle.c is included by microbench.c to reach its private kernels
+        files {"../microbench/**.c", "../headless/shim.c"}
+        files {
+            "../src/pch.c", "../src/allocator.c", "../src/platform.c", "../src/job.c", "../src/hash.c",
+            "../src/collider.c", "../src/sdf.c", "../src/domain.c", "../src/profiler.c", "../src/trace.c",
+            "../src/simd.c",
+        }
+        defines {"PARTICLE_HEADLESS"}
 
+        filter {"options:profile"}
+            defines{"PARTICLE_PROFILE"}
         filter{}
-        
+
+        if layout then
+            defines {"PARTICLE_LAYOUT=" .. particle_layouts[layout]}
+        else
+            filter {"options:layout=split"}
+                defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_SPLIT"}
+            filter {"options:layout=aosoa"}
+                defines{"PARTICLE_LAYOUT=PARTICLE_LAYOUT_AOSOA"}
+            filter{}
+        end
+
+        includedirs { "../src", "../include" }
+
+        language "C"
+        cdialect "C17"
+
+        includedirs {raylib_dir .. "/src" }
+
+        flags { "ShadowedVariables"}
+
+        filter "system:linux"
+            links {"pthread", "m"}
+        filter{}
+    end
+
+    microbench_project("microbench", nil)
+    for _, layout in ipairs({"soa", "split", "aosoa"}) do
+        microbench_project("microbench_" .. layout, layout)
+    end
 
     project "raylib"
         kind "StaticLib"
@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "particle.h"
+#include "collider.h"
+#include "job.h"
+#include "profiler.h"
+#include "simd.h"
+
+#include <stdio.h>
+
+// ------------------------
+// Headless simulation runner
+//
+// Runs a scripted scene for a fixed number of steps without a window or GL
+// context and prints step timings and a checksum of the final pool state.
+// ------------------------
+
+typedef struct HeadlessOptions
+{
+    int steps;
+    uint32_t threads;
+    uint32_t tileCount;
+    uint64_t seed;
+    int emitRate;           // particles per step and emitter
+    bool isDeterministic;
+    const char *csvPath;    // per step phase times, needs PARTICLE_PROFILE
+    bool isMeasuringHash;
+    const char *tracePath;  // Chrome trace of the first traceSteps steps, needs PARTICLE_PROFILE
+    int traceSteps;
+    SimdLevel simdLevel;    // SIMD_LEVEL_COUNT picks the widest the CPU runs
+    bool isGenericForces;
+}HeadlessOptions;
+
+static void BuildScene_(ParticleSystem *system)
+{
+    const float width = (float)(system->boundaryBox.right - system->boundaryBox.left);
+    const float height = (float)(system->boundaryBox.bottom - system->boundaryBox.top);
+
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+
+    const Vector2 ramp[] = {
+        { width * 0.10f, height * 0.40f },
+        { width * 0.35f, height * 0.55f },
+        { width * 0.45f, height * 0.55f },
+    };
+    AddPolylineCollider(system->colliders, ramp, sizeof(ramp) / sizeof(Vector2), false);
+    AddCircleCollider(system->colliders, (Vector2){ width * 0.70f, height * 0.65f }, 40.0f);
+    BuildColliderSet(system->colliders);
+}
+
+static void RunScript_(ParticleSystem *system, const HeadlessOptions *options, int step)
+{
+    const float width = (float)(system->boundaryBox.right - system->boundaryBox.left);
+    const float height = (float)(system->boundaryBox.bottom - system->boundaryBox.top);
+    const float t = (float)step / (float)options->steps;
+
+    // A sweeping emitter for the whole run and a fixed one for the first half
+    Vector2 emitters[2] = {
+        { width * (0.5f + (0.4f * sinf(2.0f * PI * t))), height * 0.1f },
+        { width * 0.2f, height * 0.2f } };
+    const int emitterCount = (t < 0.5f) ? 2 : 1;
+
+    for (int e = 0; e < emitterCount; e++)
+    {
+        for (int k = 0; k < options->emitRate; k++)
+        {
+            const Vector2 offset = { NextRandomF(&system->randomState), NextRandomF(&system->randomState) };
+            EmitParticle(system, Vector2Add(emitters[e], Vector2Scale(offset, system->emitter.radius)), &defaultParticleProps);
+        }
+    }
+
+    // Attractor in the center for the middle third, then it turns repulsive
+    if (step == options->steps / 3)
+    {
+        AddForce(system, (Force){ FORCE_ATTRACT, 0.0f, { width * 0.5f, height * 0.5f }, 5.0e5f });
+    }
+    if (step == (2 * options->steps) / 3)
+    {
+        SetForceType(system, GetForceCount(system) - 1, FORCE_REPULSE);
+    }
+}
+
+static int CompareDouble_(const void *a, const void *b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    HeadlessOptions options = { 600, 1, 0, PARTICLE_RANDOM_SEED, 4, false, NULL, false, NULL, 0, SIMD_LEVEL_COUNT, false };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--steps") == 0 && (i + 1) < argc) { options.steps = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--threads") == 0 && (i + 1) < argc) { options.threads = (uint32_t)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--tiles") == 0 && (i + 1) < argc) { options.tileCount = (uint32_t)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--seed") == 0 && (i + 1) < argc) { options.seed = strtoull(argv[++i], NULL, 0); }
+        else if (strcmp(argv[i], "--emit") == 0 && (i + 1) < argc) { options.emitRate = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--deterministic") == 0) { options.isDeterministic = true; }
+        else if (strcmp(argv[i], "--csv") == 0 && (i + 1) < argc) { options.csvPath = argv[++i]; }
+        else if (strcmp(argv[i], "--hash-stats") == 0) { options.isMeasuringHash = true; }
+        else if (strcmp(argv[i], "--trace") == 0 && (i + 1) < argc) { options.tracePath = argv[++i]; }
+        else if (strcmp(argv[i], "--trace-steps") == 0 && (i + 1) < argc) { options.traceSteps = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--generic-forces") == 0) { options.isGenericForces = true; }
+        else if (strcmp(argv[i], "--simd") == 0 && (i + 1) < argc && FindSimdLevel(argv[i + 1]) != SIMD_LEVEL_COUNT)
+        {
+            options.simdLevel = FindSimdLevel(argv[++i]);
+        }
+        else
+        {
+            printf("usage: %s [--steps N] [--threads N] [--tiles N] [--seed N] [--emit N] [--deterministic]\n"
+                   "       [--csv PATH] [--hash-stats] [--trace PATH] [--trace-steps N] [--simd scalar|sse2|avx2]\n"
+                   "       [--generic-forces]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.steps < 1) { options.steps = 1; }
+    if (options.traceSteps < 1 || options.traceSteps > options.steps) { options.traceSteps = options.steps; }
+
+    SetTraceLogLevel(LOG_WARNING);
+    if (options.simdLevel != SIMD_LEVEL_COUNT) { SetSimdLevel(options.simdLevel); }
+
+    JobSystem *jobs = (options.threads != 1) ? ConstructJobSystem(options.threads) : NULL;
+    ParticleSystem *system = ConstructParticleSystem(0, 1280, 0, 720);
+    SetJobSystem(system, jobs);
+    SetDomainDecomposition(system, options.tileCount);
+    SetDeterministic(system, options.isDeterministic);
+    SeedParticleSystem(system, options.seed);
+    SetHashDiagnostics(system, options.isMeasuringHash);
+    SetForceSpecialization(system, !options.isGenericForces);
+    BuildScene_(system);
+
+    double *stepTimes = (double*)malloc(sizeof(double) * options.steps);
+    PASSERTABORT(stepTimes, LOG_FATAL, "Failed to allocate step timings");
+
+#if defined(PARTICLE_PROFILE)
+    // Sum over all steps, the rolling history only covers the last frames
+    Profiler *profiler = ConstructProfiler();
+    double phaseTotals[PROFILE_PHASE_COUNT] = { 0 };
+    if (options.csvPath) { StartProfileCsv(profiler, options.csvPath); }
+    SetTraceThreadName("main");
+    if (options.tracePath) { StartTrace(); }
+#else
+    PASSERT(!options.csvPath && !options.tracePath, LOG_WARNING, "--csv and --trace need a build with PARTICLE_PROFILE");
+#endif
+
+    const float deltaTime = 1.0f / SIMULATION_STEP_RATE;
+    const double start = GetPlatformTime();
+    for (int step = 0; step < options.steps; step++)
+    {
+        RunScript_(system, &options, step);
+
+        const double stepStart = GetPlatformTime();
+        TRACE_SCOPE("step")
+        {
+            UpdateParticles(system, deltaTime);
+        }
+        stepTimes[step] = GetPlatformTime() - stepStart;
+
+#if defined(PARTICLE_PROFILE)
+        RecordProfileFrame(profiler, system->stats.phaseTimes);
+        for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { phaseTotals[p] += system->stats.phaseTimes[p]; }
+        if (options.tracePath && (step + 1) == options.traceSteps)
+        {
+            StopTrace();
+            FlushTrace(options.tracePath);
+        }
+#endif
+    }
+    const double elapsed = GetPlatformTime() - start;
+
+    qsort(stepTimes, options.steps, sizeof(double), CompareDouble_);
+    printf("steps:      %d (dt %.4f s, %u threads, %u tiles%s)\n", options.steps, deltaTime,
+        GetJobThreadCount(jobs), options.tileCount, options.isDeterministic ? ", deterministic" : "");
+    printf("particles:  %zu (%s layout, %s kernels, %s forces)\n", system->particles_->activeCount, particleLayoutName,
+        simdLevelNames[GetSimdKernels()->level], forceSetNames[system->stats.forceSet]);
+    printf("total:      %.3f s\n", elapsed);
+    printf("step p50:   %.3f ms\n", stepTimes[options.steps / 2] * 1000.0);
+    printf("step p99:   %.3f ms\n", stepTimes[((options.steps - 1) * 99) / 100] * 1000.0);
+    printf("checksum:   %016llx\n", (unsigned long long)HashParticleState(system));
+    printf("last step:  %zu allocations, %zu reallocations\n", system->stats.allocationCount, system->stats.reallocationCount);
+    printf("arena:      %.1f of %.1f KiB used, %.1f KiB high-water, %llu overflows\n", system->stats.arena.used / 1024.0,
+        system->stats.arena.capacity / 1024.0, system->stats.arena.highWater / 1024.0,
+        (unsigned long long)system->stats.arena.overflowCount);
+    if (options.isMeasuringHash && !system->domain)
+    {
+        const HashStats *hash = &system->stats.hash;
+        printf("hash:       %zu occupied slots, %zu cells, %zu colliding slots, %.2f mean / %zu max per slot\n",
+            hash->occupiedSlots, hash->occupiedCells, hash->collidingSlots, hash->meanPerSlot, hash->maxPerSlot);
+        printf("hash query: %.2f candidates per neighbor\n",
+            (hash->queryNeighbors > 0) ? ((double)hash->queryCandidates / (double)hash->queryNeighbors) : 0.0);
+    }
+
+#if defined(PARTICLE_PROFILE)
+    printf("phases (mean ms/step):\n");
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        if (phaseTotals[p] > 0.0) { printf("  %-14s %8.3f\n", profilePhaseNames[p], (phaseTotals[p] * 1000.0) / options.steps); }
+    }
+    DestructProfiler(profiler);
+#endif
+    const MemoryStats memory = GetMemoryStats();
+    PrintMemoryStats(&memory);
+
+    free(stepTimes);
+    DestructParticleSystem(system);
+    if (jobs) { DestructJobSystem(jobs); }
+#if defined(PARTICLE_PROFILE)
+    ShutdownTrace();
+#endif
+    return 0;
+}
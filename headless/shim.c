@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "raylib.h"
+
+// ------------------------
+// Raylib runtime shim
+//
+// The headless runner does not link raylib. The simulation only needs logging
+// from it, everything else it uses is header-only (raymath) or compiled out
+// with PARTICLE_HEADLESS.
+// ------------------------
+
+static int logLevel = LOG_INFO;
+
+void SetTraceLogLevel(int logType)
+{
+    logLevel = logType;
+}
+
+void TraceLog(int logType, const char *text, ...)
+{
+    if (logType < logLevel) { return; }
+
+    static const char *prefixes[] = { "", "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "" };
+    fprintf(stderr, "%s: ", (logType >= LOG_ALL && logType <= LOG_NONE) ? prefixes[logType] : "");
+
+    va_list args;
+    va_start(args, text);
+    vfprintf(stderr, text, args);
+    va_end(args);
+    fputc('\n', stderr);
+
+    if (logType == LOG_FATAL) { exit(EXIT_FAILURE); }
+}
@@ -0,0 +1,409 @@
+// The solver kernels are private to particle.c, so it is compiled as part of
+// this translation unit instead of being linked.
+#include "../src/particle.c"
+
+#include <stdio.h>
+
+// ------------------------
+// Kernel microbenchmarks
+//
+// Times single hash and solver kernels on synthetic particle distributions,
+// independent of the full scene. Every kernel runs warmup repetitions and then
+// timed repetitions on an identical pool, and reports the per item cost as
+// median, mean, relative standard deviation and minimum. Streaming kernels
+// also report the bandwidth of their median, next to CopyStepPositions as a
+// plain memcpy reference.
+// ------------------------
+
+typedef enum Distribution
+{
+    DISTRIBUTION_UNIFORM,       // spread at about twice the contact range
+    DISTRIBUTION_CLUSTERED,     // sixteen dense blobs
+    DISTRIBUTION_PILED,         // resting grid at contact distance
+    DISTRIBUTION_COUNT,
+}Distribution;
+
+static const char *distributionNames[DISTRIBUTION_COUNT] = { "uniform", "clustered", "piled" };
+
+typedef struct MicroContext
+{
+    ParticleSystem *system;     // pool the kernels work on
+    ParticlePool *reference;    // restored into the system pool before every repetition
+    Constraint *constraints;
+    size_t items;               // work items per repetition, the unit of the reported cost
+    double sink;                // keeps results alive
+}MicroContext;
+
+typedef void (*MicroFn)(MicroContext *context);
+
+typedef struct MicroKernel
+{
+    const char *name;
+    MicroFn SetupFn;    // once per size and distribution, untimed
+    MicroFn ResetFn;    // before every repetition after the pool is restored, untimed, may be NULL
+    MicroFn RunFn;
+    size_t bytesPerItem;    // memory traffic of streaming kernels, 0 when the cost is not bandwidth bound
+}MicroKernel;
+
+typedef struct MicroOptions
+{
+    int warmup;
+    int repetitions;
+    size_t maxSize;
+    const char *filter;     // only kernels whose name contains this
+    SimdLevel simdLevel;    // SIMD_LEVEL_COUNT picks the widest the CPU runs
+}MicroOptions;
+
+// Distributions
+// -----------------
+static void GenerateDistribution_(ParticleSystem *system, Distribution distribution, size_t count, uint64_t *random)
+{
+    ParticleProps props = defaultParticleProps;
+    props.variance = 0.0f;
+    props.lifetime = 1.0e6f;
+
+    // Keep the density independent of the particle count
+    const float spacing = 2.0f * PARTICLE_RADIUS;
+    const float extent = 2.0f * spacing * sqrtf((float)count);
+
+    Vector2 centers[16];
+    for (int c = 0; c < 16; c++) { centers[c] = (Vector2){ (0.5f + (0.4f * NextRandomF(random))) * extent, (0.5f + (0.4f * NextRandomF(random))) * extent }; }
+
+    const size_t columns = (size_t)(2.0f * sqrtf((float)count)) + 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        Vector2 position;
+        switch (distribution)
+        {
+        case DISTRIBUTION_UNIFORM:
+            position = (Vector2){ (0.5f + (0.5f * NextRandomF(random))) * extent, (0.5f + (0.5f * NextRandomF(random))) * extent };
+            break;
+        case DISTRIBUTION_CLUSTERED:
+        {
+            // Sum of two uniforms, denser towards the center
+            const Vector2 offset = { NextRandomF(random) + NextRandomF(random), NextRandomF(random) + NextRandomF(random) };
+            position = Vector2Add(centers[i % 16], Vector2Scale(offset, extent / 32.0f));
+            break;
+        }
+        case DISTRIBUTION_PILED:
+        default:
+            position = (Vector2){ (i % columns) * spacing + (0.25f * PARTICLE_RADIUS * NextRandomF(random)),
+                extent - ((i / columns) * spacing) + (0.25f * PARTICLE_RADIUS * NextRandomF(random)) };
+            break;
+        }
+
+        EmitParticle(system, position, &props);
+        SetParticleVelocity(system->particles_, i, (Vector2){ 50.0f * NextRandomF(random), 50.0f * NextRandomF(random) });
+    }
+}
+
+// Kernels
+// -----------------
+static void SetupFillHash_(MicroContext *context)
+{
+    context->items = context->system->particles_->activeCount;
+}
+
+static void ResetFillHash_(MicroContext *context)
+{
+    ClearHash(context->system->spatialHash);
+}
+
+static void RunFillHash_(MicroContext *context)
+{
+    FillHash(context->system->spatialHash, context->system->particles_);
+}
+
+static void SetupQuery_(MicroContext *context)
+{
+    ClearHash(context->system->spatialHash);
+    FillHash(context->system->spatialHash, context->system->particles_);
+    context->items = context->system->particles_->activeCount;
+}
+
+static void RunQueryPoint_(MicroContext *context)
+{
+    const ParticlePool *particles = context->system->particles_;
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        context->sink += (double)QueryHashPoint(context->system->spatialHash, GetParticlePosition(particles, i), 2.0f * PARTICLE_RADIUS);
+    }
+}
+
+static void RunQueryRange_(MicroContext *context)
+{
+    // Boxes of two contact ranges around every particle
+    const ParticlePool *particles = context->system->particles_;
+    const float range = 4.0f * PARTICLE_RADIUS;
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        const Vector2 p = GetParticlePosition(particles, i);
+        context->sink += (double)QueryHashRange(context->system->spatialHash, p.x - range, p.x + range, p.y - range, p.y + range);
+    }
+}
+
+static void SetupProjectSelfCollision_(MicroContext *context)
+{
+    // The batch the solver would see for this pool
+    SetupQuery_(context);
+    const ParticlePool *particles = context->system->particles_;
+    const float range = 2.0f * PARTICLE_RADIUS;
+
+    arrsetlen(context->constraints, 0);
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        QueryHashPoint(context->system->spatialHash, GetParticlePosition(particles, i), range);
+        const size_t *results = context->system->spatialHash->queryResults;
+        for (size_t k = 0; k < arrlenu(results); k++)
+        {
+            const size_t j = results[k];
+            if (j <= i || Vector2Distance(GetParticlePosition(particles, i), GetParticlePosition(particles, j)) >= range) { continue; }
+            arrput(context->constraints, SelfCollisionConstraint_(i, j));
+        }
+    }
+    context->items = arrlenu(context->constraints);
+}
+
+static void RunProjectSelfCollision_(MicroContext *context)
+{
+    const float deltaTime = 1.0f / (SIMULATION_STEP_RATE * PARTICLE_SUBSTEPS);
+    for (size_t c = 0; c < arrlenu(context->constraints); c++)
+    {
+        ProjectSelfCollision(&context->constraints[c], context->system->particles_, deltaTime);
+    }
+}
+
+static void SetupCalculateForces_(MicroContext *context)
+{
+    ParticleSystem *system = context->system;
+    arrsetlen(system->forces_, 0);
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_ATTRACT, 0.0f, { -100.0f, -100.0f }, 5.0e5f });
+    context->items = system->particles_->activeCount;
+}
+
+static void RunCalculateForces_(MicroContext *context)
+{
+    const ParticlePool *particles = context->system->particles_;
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        const Vector2 force = CalculateForces_(GetParticlePosition(particles, i), GetParticleVelocity(particles, i), PARTICLE_MASS(particles, i),
+            context->system->forces_);
+        context->sink += force.x + force.y;
+    }
+}
+
+static void SetupUpdateLife_(MicroContext *context)
+{
+    // Every tenth particle expires on the next update, so compaction runs too
+    ParticlePool *particles = context->system->particles_;
+    for (size_t i = 0; i < particles->activeCount; i += 10) { PARTICLE_LIFESPAN(particles, i) = PARTICLE_LIFETIME(particles, i); }
+    context->items = particles->activeCount;
+}
+
+static void RunUpdateLife_(MicroContext *context)
+{
+    UpdateParticlesLife_(context->system, 1.0f / SIMULATION_STEP_RATE);
+}
+
+static void SetupStreaming_(MicroContext *context)
+{
+    ParticleSystem *system = context->system;
+    arrsetlen(system->forces_, 0);
+    AddForce(system, (Force){ FORCE_GRAVITY, 0.0f, { 0 }, 0.0f });
+    AddForce(system, (Force){ FORCE_VISCOUS, AIR_VISCOSITY, { 0 }, 0.0f });
+    context->items = system->particles_->activeCount;
+}
+
+static void SetupGravity_(MicroContext *context)
+{
+    SetupStreaming_(context);
+    arrsetlen(context->system->forces_, 1);
+}
+
+static void SetupPointForce_(MicroContext *context)
+{
+    SetupStreaming_(context);
+    AddForce(context->system, (Force){ FORCE_ATTRACT, 0.0f, { -100.0f, -100.0f }, 5.0e5f });
+}
+
+// Same lists run through the generic per run interpreter
+static void SetupGenericStreaming_(MicroContext *context)
+{
+    SetupStreaming_(context);
+    SetForceSpecialization(context->system, false);
+}
+
+static void SetupGenericPointForce_(MicroContext *context)
+{
+    SetupPointForce_(context);
+    SetForceSpecialization(context->system, false);
+}
+
+static void RunIntegrate_(MicroContext *context)
+{
+    // Planned per call like once per substep, so the dispatch is part of the cost
+    const ForcePlan plan = PlanForces(context->system->forces_, context->system->isSpecializingForces);
+    ParticleJobContext job = { context->system, 1.0f / (SIMULATION_STEP_RATE * PARTICLE_SUBSTEPS), &plan };
+    IntegrateParticlesJob_(&job, 0, context->system->particles_->activeCount, 0);
+}
+
+static void SetupPlanForces_(MicroContext *context)
+{
+    SetupPointForce_(context);
+    context->items = 1000;
+}
+
+static void RunPlanForces_(MicroContext *context)
+{
+    for (size_t i = 0; i < context->items; i++)
+    {
+        const ForcePlan plan = PlanForces(context->system->forces_, true);
+        context->sink += (double)plan.set;
+    }
+}
+
+static void RunUpdateVelocities_(MicroContext *context)
+{
+    ParticleJobContext job = { context->system, 1.0f / (SIMULATION_STEP_RATE * PARTICLE_SUBSTEPS) };
+    UpdateVelocitiesJob_(&job, 0, context->system->particles_->activeCount, 0);
+}
+
+static void RunAgeParticles_(MicroContext *context)
+{
+    ParticleJobContext job = { context->system, 1.0f / SIMULATION_STEP_RATE };
+    AgeParticlesJob_(&job, 0, context->system->particles_->activeCount, 0);
+}
+
+static void RunCopyStepPositions_(MicroContext *context)
+{
+    CopyStepPositions_(context->system->particles_);
+}
+
+static void RunClampToWalls_(MicroContext *context)
+{
+    context->sink += (double)ClampParticlesToWalls_(context->system, 0, context->system->particles_->activeCount);
+}
+
+static const MicroKernel kernels[] = {
+    { "FillHash",             SetupFillHash_,             ResetFillHash_, RunFillHash_,               0 },
+    { "QueryHashPoint",       SetupQuery_,                NULL,           RunQueryPoint_,             0 },
+    { "QueryHashRange",       SetupQuery_,                NULL,           RunQueryRange_,             0 },
+    { "ProjectSelfCollision", SetupProjectSelfCollision_, NULL,           RunProjectSelfCollision_,   0 },
+    { "CalculateForces_",     SetupCalculateForces_,      NULL,           RunCalculateForces_,        0 },
+    { "UpdateParticlesLife_", SetupUpdateLife_,           NULL,           RunUpdateLife_,             0 },
+    { "AgeParticles",         SetupStreaming_,            NULL,           RunAgeParticles_,           2 * sizeof(float) },
+    { "CopyStepPositions",    SetupStreaming_,            NULL,           RunCopyStepPositions_,      2 * sizeof(Vector2) },
+    // positions, velocities and masses in, velocities, previous and current positions out
+    { "IntegrateParticles",   SetupStreaming_,            NULL,           RunIntegrate_,              5 * sizeof(Vector2) + sizeof(float) },
+    { "IntegrateGravity",     SetupGravity_,              NULL,           RunIntegrate_,              5 * sizeof(Vector2) + sizeof(float) },
+    { "IntegratePointForce",  SetupPointForce_,           NULL,           RunIntegrate_,              0 },
+    { "IntegrateGeneric",     SetupGenericStreaming_,     NULL,           RunIntegrate_,              5 * sizeof(Vector2) + sizeof(float) },
+    { "IntegratePointForceGeneric", SetupGenericPointForce_, NULL,        RunIntegrate_,              0 },
+    { "PlanForces",           SetupPlanForces_,           NULL,           RunPlanForces_,             0 },
+    { "UpdateVelocities",     SetupStreaming_,            NULL,           RunUpdateVelocities_,       3 * sizeof(Vector2) },
+    { "ClampParticlesToWalls", SetupStreaming_,           NULL,           RunClampToWalls_,           2 * sizeof(Vector2) },
+};
+
+// Harness
+// -----------------
+static int CompareDouble_(const void *a, const void *b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void RunKernel_(const MicroKernel *kernel, Distribution distribution, size_t count, const MicroOptions *options)
+{
+    MicroContext context = { 0 };
+    context.system = ConstructParticleSystem(0, 1280, 0, 720);
+    context.reference = (ParticlePool*)malloc(sizeof(ParticlePool));
+    PASSERTABORT(context.reference, LOG_FATAL, "Failed to allocate reference pool");
+
+    uint64_t random = PARTICLE_RANDOM_SEED;
+    GenerateDistribution_(context.system, distribution, count, &random);
+    kernel->SetupFn(&context);
+    memcpy(context.reference, context.system->particles_, sizeof(ParticlePool));
+
+    double *times = (double*)malloc(sizeof(double) * options->repetitions);
+    PASSERTABORT(times, LOG_FATAL, "Failed to allocate repetition timings");
+
+    for (int r = -options->warmup; r < options->repetitions; r++)
+    {
+        memcpy(context.system->particles_, context.reference, sizeof(ParticlePool));
+        if (kernel->ResetFn) { kernel->ResetFn(&context); }
+
+        const double start = GetPlatformTime();
+        kernel->RunFn(&context);
+        const double elapsed = GetPlatformTime() - start;
+        if (r >= 0) { times[r] = elapsed; }
+    }
+
+    // Per item cost in nanoseconds
+    const double scale = (context.items > 0) ? (1.0e9 / (double)context.items) : 0.0;
+    double mean = 0.0, variance = 0.0;
+    for (int r = 0; r < options->repetitions; r++) { mean += times[r]; }
+    mean /= options->repetitions;
+    for (int r = 0; r < options->repetitions; r++) { variance += (times[r] - mean) * (times[r] - mean); }
+    variance /= (options->repetitions > 1) ? (options->repetitions - 1) : 1;
+    qsort(times, options->repetitions, sizeof(double), CompareDouble_);
+
+    printf("%-26s %-10s %8zu %10zu %10.2f %10.2f %8.1f%% %10.2f", kernel->name, distributionNames[distribution], count,
+        context.items, times[options->repetitions / 2] * scale, mean * scale, (mean > 0.0) ? (100.0 * sqrt(variance) / mean) : 0.0,
+        times[0] * scale);
+    const double median = times[options->repetitions / 2];
+    if (kernel->bytesPerItem > 0 && median > 0.0) { printf(" %8.1f\n", ((double)kernel->bytesPerItem * context.items) / (median * 1.0e9)); }
+    else { printf(" %8s\n", "-"); }
+
+    free(times);
+    arrfree(context.constraints);
+    free(context.reference);
+    DestructParticleSystem(context.system);
+}
+
+int main(int argc, char **argv)
+{
+    MicroOptions options = { 3, 20, MAX_PARTICLE_COUNT, NULL, SIMD_LEVEL_COUNT };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--warmup") == 0 && (i + 1) < argc) { options.warmup = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--reps") == 0 && (i + 1) < argc) { options.repetitions = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--max-size") == 0 && (i + 1) < argc) { options.maxSize = (size_t)atoll(argv[++i]); }
+        else if (strcmp(argv[i], "--kernel") == 0 && (i + 1) < argc) { options.filter = argv[++i]; }
+        else if (strcmp(argv[i], "--simd") == 0 && (i + 1) < argc && FindSimdLevel(argv[i + 1]) != SIMD_LEVEL_COUNT)
+        {
+            options.simdLevel = FindSimdLevel(argv[++i]);
+        }
+        else
+        {
+            printf("usage: %s [--warmup N] [--reps N] [--max-size N] [--kernel NAME] [--simd scalar|sse2|avx2]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.warmup < 0) { options.warmup = 0; }
+    if (options.repetitions < 1) { options.repetitions = 1; }
+    if (options.maxSize > MAX_PARTICLE_COUNT) { options.maxSize = MAX_PARTICLE_COUNT; }
+    if (options.maxSize < 1) { options.maxSize = 1; }
+    const size_t minSize = (options.maxSize < 1024) ? options.maxSize : 1024;
+
+    SetTraceLogLevel(LOG_WARNING);
+    if (options.simdLevel != SIMD_LEVEL_COUNT) { SetSimdLevel(options.simdLevel); }
+    printf("Kernel microbenchmarks: %d warmup, %d repetitions, sizes %zu to %zu (MAX_PARTICLE_COUNT %d), %s pool layout, %s kernels\n",
+        options.warmup, options.repetitions, minSize, options.maxSize, MAX_PARTICLE_COUNT, particleLayoutName, simdLevelNames[GetSimdKernels()->level]);
+    printf("%-26s %-10s %8s %10s %10s %10s %9s %10s %8s\n", "kernel", "layout", "size", "items", "median ns", "mean ns", "rsd", "min ns", "GB/s");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(MicroKernel); k++)
+    {
+        if (options.filter && !strstr(kernels[k].name, options.filter)) { continue; }
+
+        // Powers of two from 1024, then the maximum itself. A maximum below 1024
+        // is the only size.
+        for (size_t count = minSize; ; count = ((count * 2) < options.maxSize) ? (count * 2) : options.maxSize)
+        {
+            for (int d = 0; d < DISTRIBUTION_COUNT; d++) { RunKernel_(&kernels[k], (Distribution)d, count, &options); }
+            if (count >= options.maxSize) { break; }
+        }
+    }
+    return 0;
+}
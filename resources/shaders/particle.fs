@@ -1,9 +1,16 @@
-#version 430 core
-out vec4 FragColor;
-
+#version 330 core
+in vec2 fCorner;
 in vec4 fColor;
 
+out vec4 FragColor;
+
 void main()
 {
-    FragColor = vec4(1.0f,0.0f,0.0f,1.0f);
-}
\ No newline at end of file
+    // Mask the quad to a unit circle with a one pixel smooth edge
+    float distance = length(fCorner);
+    float edge = fwidth(distance);
+    float coverage = 1.0 - smoothstep(1.0 - edge, 1.0, distance);
+    if (coverage <= 0.0) { discard; }
+
+    FragColor = vec4(fColor.rgb, fColor.a * coverage);
+}
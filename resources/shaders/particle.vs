@@ -1,14 +1,29 @@
-#version 430 core
-layout (location = 0) in vec2 aCoord;
+#version 330 core
+#define MAX_PALETTE_TYPES 8
 
-layout (location = 1) in vec2 aPosition;
-// layout (location = 2) in vec2 aSize; 
-// layout (location = 3) in vec4 aColor; 
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec2 aPrevPosition;  // normalized within bounds
+layout (location = 2) in vec2 aPosition;      // normalized within bounds
+layout (location = 3) in float aAge;          // lifespan / lifetime
+layout (location = 4) in float aType;         // palette index
 
+uniform mat4 mvp;
+uniform float radius;
+uniform float alpha;    // interpolant between the previous and current step
+uniform vec4 bounds;    // origin (xy) and size (zw) of the packed position range
+
+uniform vec4 birthColors[MAX_PALETTE_TYPES];
+uniform vec4 deathColors[MAX_PALETTE_TYPES];
+
+out vec2 fCorner;
 out vec4 fColor;
 
 void main()
 {
-    fColor = vec4(1.0,0.0,0.0,1.0);
-    gl_Position = vec4((aCoord + aPosition), 0.0, 1.0);
+    vec2 center = bounds.xy + (mix(aPrevPosition, aPosition, alpha) * bounds.zw);
+    int type = clamp(int(aType + 0.5), 0, MAX_PALETTE_TYPES - 1);
+
+    fCorner = aCorner;
+    fColor = mix(birthColors[type], deathColors[type], clamp(aAge, 0.0, 1.0));
+    gl_Position = mvp * vec4(center + (aCorner * radius), 0.0, 1.0);
 }
@@ -0,0 +1,341 @@
+#include "pch.h"
+#include "allocator.h"
+#include "platform.h"
+
+#include <stdio.h>
+
+const char *memoryTagNames[MEMORY_TAG_COUNT] = {
+    "other",
+    "system",
+    "state",
+    "hash",
+    "queries",
+    "constraints",
+    "forces",
+    "scratch",
+    "colliders",
+    "field",
+    "domain",
+    "simulation",
+    "renderer",
+    "trace",
+    "frame arena",
+};
+
+static Allocator allocator_ = { 0 };
+static MEMORY_THREAD_LOCAL MemoryTag threadTag_ = MEMORY_TAG_OTHER;
+static MEMORY_THREAD_LOCAL Arena *threadArena_ = NULL;
+
+static void RaisePeak_(_Atomic size_t *peak, size_t value)
+{
+    size_t previous = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > previous &&
+        !atomic_compare_exchange_weak_explicit(peak, &previous, value, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+static void AddTrackedBytes_(MemoryTag tag, size_t size)
+{
+    const size_t current = atomic_fetch_add_explicit(&allocator_.currentBytes[tag], size, memory_order_relaxed) + size;
+    const size_t total = atomic_fetch_add_explicit(&allocator_.totalBytes, size, memory_order_relaxed) + size;
+    RaisePeak_(&allocator_.peakBytes[tag], current);
+    RaisePeak_(&allocator_.totalPeakBytes, total);
+}
+
+static void RemoveTrackedBytes_(MemoryTag tag, size_t size)
+{
+    atomic_fetch_sub_explicit(&allocator_.currentBytes[tag], size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&allocator_.totalBytes, size, memory_order_relaxed);
+}
+
+void* TrackedMalloc(MemoryTag tag, size_t size)
+{
+    PASSERTRETURNVALUE(tag < MEMORY_TAG_COUNT, NULL, LOG_ERROR, "Invalid memory tag %d", (int)tag);
+
+    AllocationHeader *header = (AllocationHeader*)malloc(sizeof(AllocationHeader) + size);
+    if (!header) { return NULL; }
+
+    header->size = size;
+    header->tag = tag;
+    header->arena = NULL;
+    AddTrackedBytes_(tag, size);
+    atomic_fetch_add_explicit(&allocator_.allocationCount, 1, memory_order_relaxed);
+    return header + 1;
+}
+
+void* TrackedCalloc(MemoryTag tag, size_t count, size_t size)
+{
+    PASSERTRETURNVALUE(size == 0 || count <= (SIZE_MAX / size), NULL, LOG_ERROR, "Tracked calloc size overflow");
+
+    void *pointer = TrackedMalloc(tag, count * size);
+    if (pointer) { memset(pointer, 0, count * size); }
+    return pointer;
+}
+
+void* TrackedRealloc(void *pointer, size_t size)
+{
+    if (!pointer) { return threadArena_ ? ArenaAllocate(threadArena_, size) : TrackedMalloc(threadTag_, size); }
+    if (size == 0) { TrackedFree(pointer); return NULL; }
+
+    AllocationHeader *header = ((AllocationHeader*)pointer) - 1;
+    if (header->arena) { return ReallocateArenaBlock_(header, size); }
+
+    const size_t previousSize = header->size;
+    const MemoryTag tag = header->tag;
+
+    AllocationHeader *resized = (AllocationHeader*)realloc(header, sizeof(AllocationHeader) + size);
+    if (!resized) { return NULL; }
+
+    resized->size = size;
+    RemoveTrackedBytes_(tag, previousSize);
+    AddTrackedBytes_(tag, size);
+    atomic_fetch_add_explicit(&allocator_.reallocationCount, 1, memory_order_relaxed);
+    return resized + 1;
+}
+
+void TrackedFree(void *pointer)
+{
+    if (!pointer) { return; }
+
+    AllocationHeader *header = ((AllocationHeader*)pointer) - 1;
+    if (header->arena) { return; }
+
+    RemoveTrackedBytes_(header->tag, header->size);
+    atomic_fetch_add_explicit(&allocator_.freeCount, 1, memory_order_relaxed);
+    free(header);
+}
+
+void* TrackedAllocatePages(MemoryTag tag, size_t size, bool isHugePage)
+{
+    PASSERTRETURNVALUE(tag < MEMORY_TAG_COUNT, NULL, LOG_ERROR, "Invalid memory tag %d", (int)tag);
+
+    void *pages = AllocatePages(size, isHugePage);
+    if (!pages) { return NULL; }
+
+    AddTrackedBytes_(tag, GetPageAllocationSize(size, isHugePage));
+    atomic_fetch_add_explicit(&allocator_.allocationCount, 1, memory_order_relaxed);
+    return pages;
+}
+
+void TrackedFreePages(void *pages, MemoryTag tag, size_t size, bool isHugePage)
+{
+    if (!pages) { return; }
+
+    RemoveTrackedBytes_(tag, GetPageAllocationSize(size, isHugePage));
+    atomic_fetch_add_explicit(&allocator_.freeCount, 1, memory_order_relaxed);
+    FreePages(pages, size, isHugePage);
+}
+
+MemoryTag SetMemoryTag(MemoryTag tag)
+{
+    const MemoryTag previous = threadTag_;
+    threadTag_ = tag;
+    return previous;
+}
+
+MemoryTag GetMemoryTag()
+{
+    return threadTag_;
+}
+
+MemoryStats GetMemoryStats()
+{
+    MemoryStats stats = { 0 };
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+    {
+        stats.currentBytes[t] = atomic_load_explicit(&allocator_.currentBytes[t], memory_order_relaxed);
+        stats.peakBytes[t] = atomic_load_explicit(&allocator_.peakBytes[t], memory_order_relaxed);
+    }
+    stats.totalBytes = atomic_load_explicit(&allocator_.totalBytes, memory_order_relaxed);
+    stats.totalPeakBytes = atomic_load_explicit(&allocator_.totalPeakBytes, memory_order_relaxed);
+    stats.allocationCount = atomic_load_explicit(&allocator_.allocationCount, memory_order_relaxed);
+    stats.reallocationCount = atomic_load_explicit(&allocator_.reallocationCount, memory_order_relaxed);
+    stats.freeCount = atomic_load_explicit(&allocator_.freeCount, memory_order_relaxed);
+    return stats;
+}
+
+void ResetMemoryPeaks()
+{
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+    {
+        atomic_store_explicit(&allocator_.peakBytes[t],
+            atomic_load_explicit(&allocator_.currentBytes[t], memory_order_relaxed), memory_order_relaxed);
+    }
+    atomic_store_explicit(&allocator_.totalPeakBytes,
+        atomic_load_explicit(&allocator_.totalBytes, memory_order_relaxed), memory_order_relaxed);
+}
+
+static size_t ArenaBlockSize_(size_t size)
+{
+    // Headers and sizes are multiples of max_align_t, so every block stays aligned
+    const size_t alignment = sizeof(max_align_t);
+    return sizeof(AllocationHeader) + ((size + alignment - 1) & ~(alignment - 1));
+}
+
+static void* ReallocateArenaBlock_(AllocationHeader *header, size_t size)
+{
+    // The most recent block grows in place while the arena has room
+    Arena *arena = header->arena;
+    const uint8_t *block = (const uint8_t*)header;
+    if (block >= arena->base && block < (arena->base + arena->capacity))
+    {
+        const size_t start = (size_t)(block - arena->base);
+        size_t end = start + ArenaBlockSize_(header->size);
+        const size_t newEnd = start + ArenaBlockSize_(size);
+        if (newEnd <= arena->capacity &&
+            atomic_compare_exchange_strong_explicit(&arena->offset, &end, newEnd, memory_order_relaxed, memory_order_relaxed))
+        {
+            header->size = size;
+            return header + 1;
+        }
+    }
+
+    // Otherwise copy, the old block stays in the arena until the reset but
+    // does not count towards the high-water mark
+    atomic_fetch_add_explicit(&arena->releasedBytes, ArenaBlockSize_(header->size), memory_order_relaxed);
+    void *pointer = ArenaAllocate(arena, size);
+    if (pointer) { memcpy(pointer, header + 1, (header->size < size) ? header->size : size); }
+    return pointer;
+}
+
+static void FreeArenaOverflow_(Arena *arena)
+{
+    ArenaOverflow *block = atomic_exchange_explicit(&arena->overflow, NULL, memory_order_acquire);
+    while (block)
+    {
+        ArenaOverflow *next = block->next;
+        TrackedFree(block);
+        block = next;
+    }
+}
+
+Arena* ConstructArena(size_t capacity)
+{
+    Arena *arena = (Arena*)TrackedMalloc(MEMORY_TAG_ARENA, sizeof(Arena));
+    PASSERTRETURNVALUE(arena, NULL, LOG_FATAL, "Failed to allocate frame arena");
+
+    arena->base = (uint8_t*)TrackedMalloc(MEMORY_TAG_ARENA, capacity);
+    PASSERT(arena->base || capacity == 0, LOG_WARNING, "Failed to reserve %zu bytes for a frame arena", capacity);
+    arena->capacity = arena->base ? capacity : 0;
+    atomic_init(&arena->offset, 0);
+    atomic_init(&arena->releasedBytes, 0);
+    arena->highWater = 0;
+    atomic_init(&arena->overflow, NULL);
+    atomic_init(&arena->overflowCount, 0);
+    return arena;
+}
+
+void DestructArena(Arena *this)
+{
+    FreeArenaOverflow_(this);
+    TrackedFree(this->base);
+    TrackedFree(this);
+}
+
+void* ArenaAllocate(Arena *this, size_t size)
+{
+    const size_t blockSize = ArenaBlockSize_(size);
+    const size_t offset = atomic_fetch_add_explicit(&this->offset, blockSize, memory_order_relaxed);
+    AllocationHeader *header = NULL;
+    if (offset + blockSize <= this->capacity)
+    {
+        header = (AllocationHeader*)(this->base + offset);
+    }
+    else
+    {
+        // Full, keep the block on the heap until the next reset
+        ArenaOverflow *block = (ArenaOverflow*)TrackedMalloc(MEMORY_TAG_ARENA, sizeof(ArenaOverflow) + blockSize);
+        PASSERTRETURNVALUE(block, NULL, LOG_ERROR, "Failed to allocate frame arena overflow of %zu bytes", size);
+
+        block->next = atomic_load_explicit(&this->overflow, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&this->overflow, &block->next, block, memory_order_release, memory_order_relaxed)) { }
+        atomic_fetch_add_explicit(&this->overflowCount, 1, memory_order_relaxed);
+        header = (AllocationHeader*)(block + 1);
+    }
+
+    header->size = size;
+    header->tag = MEMORY_TAG_ARENA;
+    header->arena = this;
+    return header + 1;
+}
+
+void ResetArena(Arena *this)
+{
+    const size_t used = atomic_load_explicit(&this->offset, memory_order_relaxed) -
+        atomic_load_explicit(&this->releasedBytes, memory_order_relaxed);
+    if (used > this->highWater) { this->highWater = used; }
+    FreeArenaOverflow_(this);
+
+    // Grow to the high-water mark, never shrink. Nothing in the old block is
+    // alive anymore, so it is released before the new one is allocated.
+    if (this->highWater > this->capacity)
+    {
+        TrackedFree(this->base);
+        this->base = (uint8_t*)TrackedMalloc(MEMORY_TAG_ARENA, this->highWater);
+        PASSERT(this->base, LOG_WARNING, "Failed to grow frame arena to %zu bytes", this->highWater);
+        this->capacity = this->base ? this->highWater : 0;
+    }
+
+    atomic_store_explicit(&this->offset, 0, memory_order_relaxed);
+    atomic_store_explicit(&this->releasedBytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&this->overflowCount, 0, memory_order_relaxed);
+}
+
+ArenaStats GetArenaStats(Arena *this)
+{
+    ArenaStats stats = { 0 };
+    stats.capacity = this->capacity;
+    stats.used = atomic_load_explicit(&this->offset, memory_order_relaxed) -
+        atomic_load_explicit(&this->releasedBytes, memory_order_relaxed);
+    stats.highWater = (stats.used > this->highWater) ? stats.used : this->highWater;
+    stats.overflowCount = atomic_load_explicit(&this->overflowCount, memory_order_relaxed);
+    return stats;
+}
+
+ArenaScope BeginArenaScope(Arena *arena)
+{
+    ArenaScope scope = { threadArena_, true };
+    threadArena_ = arena;
+    return scope;
+}
+
+void EndArenaScope(ArenaScope *scope)
+{
+    threadArena_ = scope->previous;
+    scope->isOpen = false;
+}
+
+void PrintMemoryStats(const MemoryStats *stats)
+{
+    printf("%-12s %12s %12s\n", "memory", "current KiB", "peak KiB");
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+    {
+        if (stats->peakBytes[t] == 0) { continue; }
+        printf("%-12s %12.1f %12.1f\n", memoryTagNames[t], stats->currentBytes[t] / 1024.0, stats->peakBytes[t] / 1024.0);
+    }
+    printf("%-12s %12.1f %12.1f\n", "total", stats->totalBytes / 1024.0, stats->totalPeakBytes / 1024.0);
+    printf("%llu allocations, %llu reallocations, %llu frees\n", (unsigned long long)stats->allocationCount,
+        (unsigned long long)stats->reallocationCount, (unsigned long long)stats->freeCount);
+}
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawMemoryOverlay(const MemoryStats *stats, size_t allocationsPerStep, size_t reallocationsPerStep, int x, int y)
+{
+    const int rowHeight = 10, barWidth = 60;
+    const int height = ((MEMORY_TAG_COUNT + 2) * rowHeight) + 6;
+    DrawRectangle(x, y, 260, height, Fade(SKYBLUE, 0.5f));
+    DrawRectangleLines(x, y, 260, height, BLUE);
+    DrawText("Memory KiB (current / peak)", x + 5, y + 2, 10, DARKGRAY);
+
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+    {
+        const int rowY = y + 2 + ((t + 1) * rowHeight);
+        const float share = (stats->totalPeakBytes > 0) ? ((float)stats->peakBytes[t] / (float)stats->totalPeakBytes) : 0.0f;
+        DrawText(TextFormat("%-11s %8.1f / %8.1f", memoryTagNames[t], stats->currentBytes[t] / 1024.0, stats->peakBytes[t] / 1024.0),
+            x + 5, rowY, 10, DARKGRAY);
+        DrawRectangle(x + 195, rowY + 1, (int)(share * barWidth), rowHeight - 2, BLUE);
+    }
+
+    DrawText(TextFormat("Per step: %i allocations, %i reallocations", (int)allocationsPerStep, (int)reallocationsPerStep),
+        x + 5, y + 2 + ((MEMORY_TAG_COUNT + 1) * rowHeight), 10, DARKGRAY);
+}
+#endif
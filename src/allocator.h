@@ -0,0 +1,171 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#if defined(_MSC_VER)
+    #define MEMORY_THREAD_LOCAL __declspec(thread)
+#else
+    #define MEMORY_THREAD_LOCAL _Thread_local
+#endif
+
+// Memory tags
+// -----------------
+// Every tracked block belongs to one subsystem. Blocks keep the tag they were
+// allocated with when they are resized, so a stb_ds array is accounted to the
+// subsystem that created it no matter where it grows later.
+typedef enum MemoryTag
+{
+    MEMORY_TAG_OTHER,
+    MEMORY_TAG_SYSTEM,          // particle system, job system and profiler
+    MEMORY_TAG_STATE,           // page block of a particle system, its pool and its spatial hash
+    MEMORY_TAG_HASH,            // spatial hash tables
+    MEMORY_TAG_QUERIES,         // spatial hash query results
+    MEMORY_TAG_CONSTRAINTS,     // solver and contact constraints
+    MEMORY_TAG_FORCES,
+    MEMORY_TAG_SCRATCH,         // per worker and per chunk scratch descriptors
+    MEMORY_TAG_COLLIDERS,
+    MEMORY_TAG_FIELD,           // signed distance field and its bake buffers
+    MEMORY_TAG_DOMAIN,          // domain tiles and their local copies
+    MEMORY_TAG_SIMULATION,      // simulation thread and render snapshots
+    MEMORY_TAG_RENDERER,
+    MEMORY_TAG_TRACE,
+    MEMORY_TAG_ARENA,           // frame arenas, blocks inside them are not tracked individually
+    MEMORY_TAG_COUNT,
+}MemoryTag;
+
+// Forward declaration
+typedef struct Arena Arena;
+
+// Accounting
+// -----------------
+// Each tracked block carries a small header with its size and tag. Counters
+// are process wide atomics, so any thread may allocate and read them. Blocks
+// inside a frame arena carry the same header with the arena set, resizing
+// them bump allocates again and freeing them is a no-op.
+typedef union AllocationHeader
+{
+    struct
+    {
+        size_t size;
+        MemoryTag tag;
+        Arena *arena;       // NULL for heap blocks
+    };
+    max_align_t alignment;
+}AllocationHeader;
+
+typedef struct MemoryStats
+{
+    size_t currentBytes[MEMORY_TAG_COUNT];
+    size_t peakBytes[MEMORY_TAG_COUNT];
+    size_t totalBytes, totalPeakBytes;
+    uint64_t allocationCount;       // new blocks
+    uint64_t reallocationCount;     // existing blocks resized in place or moved
+    uint64_t freeCount;
+}MemoryStats;
+
+typedef struct Allocator
+{
+    _Atomic size_t currentBytes[MEMORY_TAG_COUNT];
+    _Atomic size_t peakBytes[MEMORY_TAG_COUNT];
+    _Atomic size_t totalBytes;
+    _Atomic size_t totalPeakBytes;
+    _Atomic uint64_t allocationCount;
+    _Atomic uint64_t reallocationCount;
+    _Atomic uint64_t freeCount;
+}Allocator;
+
+// Frame arenas
+// -----------------
+// Bump allocator for transient data that is rebuilt every frame. Allocation is
+// a single atomic add, so worker threads may share one arena. Requests past
+// the capacity fall back to heap blocks that live until the next reset. The
+// arena only grows in ResetArena, to the high-water mark of the last frame, so
+// the steady state makes no heap allocations at all.
+typedef union ArenaOverflow
+{
+    union ArenaOverflow *next;
+    max_align_t alignment;
+}ArenaOverflow;
+
+struct Arena
+{
+    uint8_t *base;
+    size_t capacity;
+    _Atomic size_t offset;          // bytes requested since the reset, may exceed the capacity
+    _Atomic size_t releasedBytes;   // blocks left behind by resizes that had to copy
+    size_t highWater;               // most live bytes of any frame
+    ArenaOverflow *_Atomic overflow;
+    _Atomic uint64_t overflowCount; // heap fallbacks since the reset
+};
+
+typedef struct ArenaStats
+{
+    size_t capacity;
+    size_t used;                    // live bytes since the last reset
+    size_t highWater;
+    uint64_t overflowCount;
+}ArenaStats;
+
+typedef struct ArenaScope
+{
+    Arena *previous;
+    bool isOpen;
+}ArenaScope;
+
+// ARENA_SCOPE(arena) { ... } makes blocks first allocated by this thread
+// inside the block, stb_ds arrays in particular, come from the arena. They
+// must not be used after the arena is reset. The block must not break or return.
+#define ARENA_SCOPE(arena) \
+    for (ArenaScope arenaScope_ = BeginArenaScope(arena); arenaScope_.isOpen; EndArenaScope(&arenaScope_))
+
+// MEMORY_SCOPE(tag) { ... } sets the tag of blocks first allocated by this
+// thread inside the block, stb_ds arrays in particular. Owners reserve their
+// arrays under a scope when they are constructed, later growth on any thread
+// keeps that tag. The block must not break or return.
+#define MEMORY_SCOPE(tag) \
+    for (int memoryPrevious_ = (int)SetMemoryTag(tag), memoryOnce_ = 1; memoryOnce_; \
+        SetMemoryTag((MemoryTag)memoryPrevious_), memoryOnce_ = 0)
+
+// declare extern variables
+// -----------------
+extern const char *memoryTagNames[MEMORY_TAG_COUNT];
+
+// Private methods
+// -----------------
+static void RaisePeak_(_Atomic size_t *peak, size_t value);
+static void AddTrackedBytes_(MemoryTag tag, size_t size);
+static void RemoveTrackedBytes_(MemoryTag tag, size_t size);
+static size_t ArenaBlockSize_(size_t size);
+static void* ReallocateArenaBlock_(AllocationHeader *header, size_t size);
+static void FreeArenaOverflow_(Arena *arena);
+
+// Interface methods
+// -----------------
+void* TrackedMalloc(MemoryTag tag, size_t size);
+void* TrackedCalloc(MemoryTag tag, size_t count, size_t size);
+void* TrackedRealloc(void *pointer, size_t size);    // new blocks take the thread's current tag
+void TrackedFree(void *pointer);
+void* TrackedAllocatePages(MemoryTag tag, size_t size, bool isHugePage);    // page aligned and zeroed, accounted at the mapped size
+void TrackedFreePages(void *pages, MemoryTag tag, size_t size, bool isHugePage);
+
+MemoryTag SetMemoryTag(MemoryTag tag);      // returns the previous tag
+MemoryTag GetMemoryTag();
+
+MemoryStats GetMemoryStats();
+void ResetMemoryPeaks();        // peaks restart from the current usage
+void PrintMemoryStats(const MemoryStats *stats);
+
+Arena* ConstructArena(size_t capacity);
+void DestructArena(Arena *this);
+void* ArenaAllocate(Arena *this, size_t size);
+void ResetArena(Arena *this);       // invalidates every block, no thread may allocate concurrently
+ArenaStats GetArenaStats(Arena *this);
+
+ArenaScope BeginArenaScope(Arena *arena);
+void EndArenaScope(ArenaScope *scope);
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawMemoryOverlay(const MemoryStats *stats, size_t allocationsPerStep, size_t reallocationsPerStep, int x, int y);
+#endif
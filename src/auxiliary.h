@@ -24,11 +24,37 @@
         } \
     } while (0)
 
+#define PASSERTRETURNVALUE(cond, value, level, format, ...)\
+    do { \
+        if(!(cond)) { \
+            TraceLog(level, "Assertion Failed: " format, ##__VA_ARGS__); \
+            return (value); \
+        } \
+    } while (0)
+
 inline static float GetRandomValueF()
 {
     return ((2.0f * ((float)GetRandomValue(0, INT32_MAX) / (float)INT32_MAX)) - 1.0f);
 }
 
+// xorshift64* generator. Each owner keeps its own state so a seeded stream
+// does not depend on other users of raylib's global generator.
+inline static uint32_t NextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// Uniform value in [-1.0, 1.0]
+inline static float NextRandomF(uint64_t *state)
+{
+    return ((2.0f * ((float)(NextRandom(state) >> 8) / (float)0xFFFFFF)) - 1.0f);
+}
+
 inline static Vector2 ReflectV(Vector2 vector, Vector2 surfaceNormal)
 {
     // R = V - 2 * (V ⋅ N) * N
@@ -0,0 +1,261 @@
+#include "pch.h"
+#include "collider.h"
+
+static void CalculateColliderBounds_(const Collider *collider, Vector2 *min, Vector2 *max)
+{
+    switch (collider->type)
+    {
+    case COLLIDER_SEGMENT:
+        *min = Vector2Min(collider->start, collider->end);
+        *max = Vector2Max(collider->start, collider->end);
+        break;
+    case COLLIDER_CIRCLE:
+        *min = Vector2SubtractValue(collider->center, collider->radius);
+        *max = Vector2AddValue(collider->center, collider->radius);
+        break;
+    default:
+        *min = (Vector2){ 0 };
+        *max = (Vector2){ 0 };
+        break;
+    }
+}
+
+static uint32_t BuildColliderNode_(ColliderSet *this, uint32_t begin, uint32_t end)
+{
+    const uint32_t nodeIndex = (uint32_t)arrlenu(this->nodes);
+    arrput(this->nodes, (ColliderNode){ 0 });
+
+    // Bounds of the colliders and of their centroids. The centroid bounds
+    // determine the split axis.
+    Vector2 min = { INFINITY, INFINITY }, max = { -INFINITY, -INFINITY };
+    Vector2 centroidMin = min, centroidMax = max;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        Vector2 cMin, cMax;
+        CalculateColliderBounds_(&this->colliders[this->colliderIndices[i]], &cMin, &cMax);
+        const Vector2 centroid = Vector2Scale(Vector2Add(cMin, cMax), 0.5f);
+
+        min = Vector2Min(min, cMin);
+        max = Vector2Max(max, cMax);
+        centroidMin = Vector2Min(centroidMin, centroid);
+        centroidMax = Vector2Max(centroidMax, centroid);
+    }
+    this->nodes[nodeIndex].min = min;
+    this->nodes[nodeIndex].max = max;
+
+    if ((end - begin) <= COLLIDER_LEAF_SIZE)
+    {
+        this->nodes[nodeIndex].start = begin;
+        this->nodes[nodeIndex].count = end - begin;
+        return nodeIndex;
+    }
+
+    // Partition about the midpoint of the longest centroid axis. Fall back to
+    // an even split when every centroid lands on one side.
+    const bool splitX = (centroidMax.x - centroidMin.x) >= (centroidMax.y - centroidMin.y);
+    const float split = splitX ? 0.5f * (centroidMin.x + centroidMax.x) : 0.5f * (centroidMin.y + centroidMax.y);
+
+    uint32_t mid = begin;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        Vector2 cMin, cMax;
+        CalculateColliderBounds_(&this->colliders[this->colliderIndices[i]], &cMin, &cMax);
+        const float centroid = splitX ? 0.5f * (cMin.x + cMax.x) : 0.5f * (cMin.y + cMax.y);
+        if (centroid < split)
+        {
+            const uint32_t temp = this->colliderIndices[i];
+            this->colliderIndices[i] = this->colliderIndices[mid];
+            this->colliderIndices[mid] = temp;
+            mid++;
+        }
+    }
+    if (mid == begin || mid == end) { mid = begin + ((end - begin) / 2); }
+
+    BuildColliderNode_(this, begin, mid);
+    const uint32_t right = BuildColliderNode_(this, mid, end);
+
+    // this->nodes may have been reallocated by the recursive calls
+    this->nodes[nodeIndex].start = right;
+    this->nodes[nodeIndex].count = 0;
+    return nodeIndex;
+}
+
+static bool CollideParticle_(const Collider *collider, Vector2 position, float radius, ColliderContact *contact)
+{
+    Vector2 closestPoint, surfaceNormal;
+    float distance, surfaceOffset;
+
+    switch (collider->type)
+    {
+    case COLLIDER_SEGMENT:
+    {
+        const Vector2 segment = Vector2Subtract(collider->end, collider->start);
+        const float lengthSqr = Vector2LengthSqr(segment);
+        const float t = (lengthSqr > EPSILON) ?
+            Clamp(Vector2DotProduct(Vector2Subtract(position, collider->start), segment) / lengthSqr, 0.0f, 1.0f) : 0.0f;
+
+        closestPoint = Vector2Add(collider->start, Vector2Scale(segment, t));
+        distance = Vector2Distance(position, closestPoint);
+        if (distance >= radius) { return false; }
+
+        // Particle centered on the segment. Push it out along the segment normal.
+        surfaceNormal = (distance > EPSILON) ?
+            Vector2Scale(Vector2Subtract(position, closestPoint), 1.0f / distance) :
+            Vector2Normalize((Vector2){ -segment.y, segment.x });
+        surfaceOffset = radius;
+        break;
+    }
+    case COLLIDER_CIRCLE:
+    {
+        closestPoint = collider->center;
+        distance = Vector2Distance(position, closestPoint);
+        if (distance >= (collider->radius + radius)) { return false; }
+
+        surfaceNormal = (distance > EPSILON) ?
+            Vector2Scale(Vector2Subtract(position, closestPoint), 1.0f / distance) : (Vector2){ 0.0f, -1.0f };
+        surfaceOffset = collider->radius + radius;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    contact->surfaceNormal = surfaceNormal;
+    contact->entryPoint = Vector2Add(closestPoint, Vector2Scale(surfaceNormal, surfaceOffset));
+    return true;
+}
+
+ColliderSet* ConstructColliderSet()
+{
+    ColliderSet *colliderSet = (ColliderSet*)TrackedMalloc(MEMORY_TAG_COLLIDERS, sizeof(ColliderSet));
+    PASSERT(colliderSet, LOG_FATAL, "Failed to allocate collider set");
+    if(!colliderSet) { return NULL; }
+
+    colliderSet->isBuilt = true;
+    colliderSet->colliders = NULL;
+    colliderSet->colliderIndices = NULL;
+    colliderSet->nodes = NULL;
+    MEMORY_SCOPE(MEMORY_TAG_COLLIDERS)
+    {
+        arrsetcap(colliderSet->colliders, 16);
+        arrsetcap(colliderSet->colliderIndices, 16);
+        arrsetcap(colliderSet->nodes, 32);
+    }
+
+    return colliderSet;
+}
+
+void DestructColliderSet(ColliderSet *this)
+{
+    arrfree(this->colliders);
+    arrfree(this->colliderIndices);
+    arrfree(this->nodes);
+    TrackedFree(this);
+}
+
+void AddSegmentCollider(ColliderSet *this, Vector2 start, Vector2 end)
+{
+    Collider c = { 0 };
+    c.type = COLLIDER_SEGMENT;
+    c.start = start;
+    c.end = end;
+
+    arrput(this->colliders, c);
+    this->isBuilt = false;
+}
+
+void AddPolylineCollider(ColliderSet *this, const Vector2 *points, size_t pointCount, bool isClosed)
+{
+    PASSERTRETURN(pointCount >= 2, LOG_WARNING, "Polyline collider requires at least 2 points.");
+
+    for (size_t i = 1; i < pointCount; i++)
+    {
+        AddSegmentCollider(this, points[i - 1], points[i]);
+    }
+    if (isClosed && pointCount > 2) { AddSegmentCollider(this, points[pointCount - 1], points[0]); }
+}
+
+void AddCircleCollider(ColliderSet *this, Vector2 center, float radius)
+{
+    PASSERTRETURN(radius > EPSILON, LOG_WARNING, "Circle collider radius must be greater than zero.");
+
+    Collider c = { 0 };
+    c.type = COLLIDER_CIRCLE;
+    c.center = center;
+    c.radius = radius;
+
+    arrput(this->colliders, c);
+    this->isBuilt = false;
+}
+
+void BuildColliderSet(ColliderSet *this)
+{
+    arrsetlen(this->nodes, 0);
+    arrsetlen(this->colliderIndices, arrlenu(this->colliders));
+    for (uint32_t i = 0; i < arrlenu(this->colliders); i++) { this->colliderIndices[i] = i; }
+
+    if (arrlenu(this->colliders) > 0)
+    {
+        BuildColliderNode_(this, 0, (uint32_t)arrlenu(this->colliders));
+    }
+    this->isBuilt = true;
+}
+
+size_t QueryColliderContacts(const ColliderSet *this, Vector2 position, float radius, ColliderContact *contacts)
+{
+    PASSERT(this->isBuilt, LOG_WARNING, "Collider set queried before it was built.");
+    if (arrlenu(this->nodes) == 0) { return 0; }
+
+    const Vector2 qMin = Vector2SubtractValue(position, radius);
+    const Vector2 qMax = Vector2AddValue(position, radius);
+
+    size_t contactCount = 0;
+    uint32_t stack[COLLIDER_STACK_SIZE];
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0 && contactCount < MAX_COLLIDER_CONTACTS)
+    {
+        const ColliderNode *node = &this->nodes[stack[--stackSize]];
+        if (qMax.x < node->min.x || qMin.x > node->max.x ||
+            qMax.y < node->min.y || qMin.y > node->max.y) { continue; }
+
+        if (node->count > 0)
+        {
+            for (uint32_t i = node->start; i < (node->start + node->count) && contactCount < MAX_COLLIDER_CONTACTS; i++)
+            {
+                if (CollideParticle_(&this->colliders[this->colliderIndices[i]], position, radius, &contacts[contactCount]))
+                {
+                    contactCount++;
+                }
+            }
+            continue;
+        }
+
+        PASSERT((stackSize + 2) <= COLLIDER_STACK_SIZE, LOG_ERROR, "Collider BVH traversal stack overflow.");
+        if ((stackSize + 2) > COLLIDER_STACK_SIZE) { break; }
+        stack[stackSize++] = node->start;
+        stack[stackSize++] = (uint32_t)(node - this->nodes) + 1;
+    }
+    return contactCount;
+}
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawColliders(const Collider *colliders, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (colliders[i].type)
+        {
+        case COLLIDER_SEGMENT:
+            DrawLineV(colliders[i].start, colliders[i].end, DARKGRAY);
+            break;
+        case COLLIDER_CIRCLE:
+            DrawCircleLinesV(colliders[i].center, colliders[i].radius, DARKGRAY);
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include "raylib.h"
+
+#define MAX_COLLIDER_CONTACTS 4
+#define COLLIDER_LEAF_SIZE 4
+#define COLLIDER_STACK_SIZE 64
+
+// Colliders
+// -----------------
+typedef enum ColliderType
+{
+    COLLIDER_SEGMENT,
+    COLLIDER_CIRCLE,
+}ColliderType;
+
+typedef struct Collider
+{
+    ColliderType type;
+
+    // COLLIDER_SEGMENT
+    Vector2 start, end;
+
+    // COLLIDER_CIRCLE
+    Vector2 center;
+    float radius;
+}Collider;
+
+typedef struct ColliderContact
+{
+    Vector2 surfaceNormal;
+    Vector2 entryPoint;
+}ColliderContact;
+
+// Bounding volume hierarchy
+// -----------------
+// Nodes are stored depth first. The left child of an interior node immediately
+// follows its parent, the right child is stored in `start`. Leaf nodes reference
+// `count` colliders beginning at `start` in the colliderIndices array.
+typedef struct ColliderNode
+{
+    Vector2 min, max;
+    uint32_t start;
+    uint32_t count;
+}ColliderNode;
+
+typedef struct ColliderSet
+{
+    bool isBuilt;
+
+    Collider *colliders;
+    uint32_t *colliderIndices;
+    ColliderNode *nodes;
+}ColliderSet;
+
+// Private methods
+// -----------------
+static void CalculateColliderBounds_(const Collider *collider, Vector2 *min, Vector2 *max);
+static uint32_t BuildColliderNode_(ColliderSet *this, uint32_t begin, uint32_t end);
+static bool CollideParticle_(const Collider *collider, Vector2 position, float radius, ColliderContact *contact);
+
+// Interface methods
+// -----------------
+ColliderSet* ConstructColliderSet();
+void DestructColliderSet(ColliderSet *this);
+
+void AddSegmentCollider(ColliderSet *this, Vector2 start, Vector2 end);
+void AddPolylineCollider(ColliderSet *this, const Vector2 *points, size_t pointCount, bool isClosed);
+void AddCircleCollider(ColliderSet *this, Vector2 center, float radius);
+
+void BuildColliderSet(ColliderSet *this);
+size_t QueryColliderContacts(const ColliderSet *this, Vector2 position, float radius, ColliderContact *contacts);
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawColliders(const Collider *colliders, size_t count);
+#endif
@@ -1,3 +1,32 @@
 #define MAX_PARTICLE_COUNT 8192
 #define GRAVITIONAL_CONST 9.8f
-#define AIR_VISCOSITY 1.81e-5
\ No newline at end of file
+#define AIR_VISCOSITY 1.81e-5
+
+#define PARTICLE_SUBSTEPS 6     // solver substeps per UpdateParticles call
+
+#define JOB_THREAD_COUNT 0      // worker threads including the main thread, 0 = hardware thread count
+#define JOB_GRAIN_SIZE 256      // particles per parallel-for chunk
+#define CACHE_LINE_SIZE 64
+
+// Memory layout of the particle pool, see ParticlePool in particle.h. Built
+// with the default unless PARTICLE_LAYOUT is defined (premake --layout).
+#define PARTICLE_LAYOUT_SOA 0       // one array per attribute, Vector2 attributes interleave x and y
+#define PARTICLE_LAYOUT_SPLIT 1     // one array per component, x and y apart
+#define PARTICLE_LAYOUT_AOSOA 2     // blocks of PARTICLE_BLOCK_SIZE particles with split components
+#if !defined(PARTICLE_LAYOUT)
+    #define PARTICLE_LAYOUT PARTICLE_LAYOUT_SOA
+#endif
+#define PARTICLE_BLOCK_SIZE 8
+#define PARTICLE_HUGE_PAGES 1   // back the particle system state with transparent huge pages where the platform has them
+#define FRAME_ARENA_CAPACITY (1 << 20)  // initial bytes of the per system frame arena, grows to the high-water mark
+#define PARTICLE_RANDOM_SEED 0x2545F4914F6CDD1DULL   // default seed of the particle system random stream
+#define DOMAIN_TILE_COUNT 8     // vertical strips used by the domain decomposition solver
+
+// Per-phase profiler timers. Debug builds always have them, release builds
+// only when PARTICLE_PROFILE is defined explicitly (premake --profile).
+#if !defined(PARTICLE_PROFILE) && !defined(NDEBUG)
+    #define PARTICLE_PROFILE
+#endif
+
+#define SIMULATION_STEP_RATE 60.0f  // simulation steps per second, may be lower than the display rate
+#define SIMULATION_MAX_STEPS 4      // catch-up steps per update before the backlog is dropped
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "pch.h"
+#include "domain.h"
+
+#include "particle.h"
+#include "hash.h"
+#include "collider.h"
+#include "sdf.h"
+#include "job.h"
+
+static void AssignDomainTiles_(Domain *this, const ParticleSystem *system)
+{
+    const ParticlePool *particles = system->particles_;
+    const float left = (float)system->boundaryBox.left;
+    const float tileWidth = (float)(system->boundaryBox.right - system->boundaryBox.left) / (float)this->tileCount;
+    const int lastTile = (int)this->tileCount - 1;
+
+    for (uint32_t t = 0; t < this->tileCount; t++)
+    {
+        this->tiles[t].xMin = left + (t * tileWidth);
+        this->tiles[t].xMax = this->tiles[t].xMin + tileWidth;
+        arrsetlen(this->tiles[t].particles, 0);
+    }
+
+    // Owned particles. Particles outside of the boundary box belong to the
+    // nearest edge tile. Scanning in index order keeps each tile sorted.
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        const int t = Clamp((int)((GetParticlePosition(particles, i).x - left) / tileWidth), 0, lastTile);
+        arrput(this->tiles[t].particles, i);
+    }
+    for (uint32_t t = 0; t < this->tileCount; t++) { this->tiles[t].ownedCount = arrlenu(this->tiles[t].particles); }
+
+    // Ghost particles within one contact range of a neighbouring tile
+    for (size_t i = 0; i < particles->activeCount; i++)
+    {
+        const float x = GetParticlePosition(particles, i).x;
+        const int t = Clamp((int)((x - left) / tileWidth), 0, lastTile);
+        if (t > 0 && (x - this->tiles[t].xMin) < this->ghostWidth) { arrput(this->tiles[t - 1].particles, i); }
+        if (t < lastTile && (this->tiles[t].xMax - x) < this->ghostWidth) { arrput(this->tiles[t + 1].particles, i); }
+    }
+}
+
+static void SolveDomainTile_(DomainTile *tile, const ParticleSystem *system, float deltaTime)
+{
+    const ParticlePool *particles = system->particles_;
+
+    size_t count = arrlenu(tile->particles);
+    PASSERT(count <= MAX_PARTICLE_COUNT, LOG_WARNING, "Domain tile exceeds MAX_PARTICLE_COUNT. Dropping ghost particles.");
+    if (count > MAX_PARTICLE_COUNT) { count = MAX_PARTICLE_COUNT; }
+
+    // Gather local copies
+    arrsetlen(tile->positions, count);
+    arrsetlen(tile->inverseMasses, count);
+    for (size_t k = 0; k < count; k++)
+    {
+        tile->positions[k] = GetParticlePosition(particles, tile->particles[k]);
+        tile->inverseMasses[k] = 1.0f / PARTICLE_MASS(particles, tile->particles[k]);
+    }
+
+    // Tile local spatial hash
+    ClearHash(tile->hash);
+    CalculateHashCells(tile->hash, tile->positions, 0, count);
+    FillHashFromCells(tile->hash, count);
+
+    // Contacts of owned particles. The global solver projects every contact
+    // once from each side, as (i, j) and as (j, i). Owned pairs get both
+    // orders from the loop below. The reverse order of an owned-ghost pair
+    // belongs to the neighbouring tile, whose result for this particle is
+    // discarded, so it is emitted here as well.
+    arrsetlen(tile->constraints, 0);
+    const float range = 2.0f * PARTICLE_RADIUS;
+    for (size_t a = 0; a < tile->ownedCount; a++)
+    {
+        const Vector2 P = tile->positions[a];
+
+        if (system->collisionMode == COLLISION_MODE_GEOMETRY)
+        {
+            ColliderContact contacts[MAX_COLLIDER_CONTACTS];
+            const size_t contactCount = QueryColliderContacts(system->colliders, P, PARTICLE_RADIUS, contacts);
+            for (size_t j = 0; j < contactCount; j++)
+            {
+                Constraint c = { 0 };
+                c.type = CONSTRAINT_SURFACE_COLLISION;
+                c.participants[0] = a;
+                c.participantCount = 1;
+                c.surfaceNormal = contacts[j].surfaceNormal;
+                c.entryPoint = contacts[j].entryPoint;
+                arrput(tile->constraints, c);
+            }
+        }
+        else if (system->collisionMode == COLLISION_MODE_FIELD && system->collisionField)
+        {
+            Vector2 gradient;
+            const float distance = SampleSignedDistanceField(system->collisionField, P, &gradient);
+            const float gradientLength = Vector2Length(gradient);
+            if (distance < PARTICLE_RADIUS && gradientLength > EPSILON)
+            {
+                Constraint c = { 0 };
+                c.type = CONSTRAINT_SURFACE_COLLISION;
+                c.participants[0] = a;
+                c.participantCount = 1;
+                c.surfaceNormal = Vector2Scale(gradient, 1.0f / gradientLength);
+                c.entryPoint = Vector2Add(P, Vector2Scale(c.surfaceNormal, PARTICLE_RADIUS - distance));
+                arrput(tile->constraints, c);
+            }
+        }
+
+        QueryHashPointInto(tile->hash, P, range, &tile->queryResults);
+        for (size_t j = 0; j < arrlenu(tile->queryResults); j++)
+        {
+            const size_t b = tile->queryResults[j];
+            if (a == b) { continue; }
+            if (Vector2Distance(P, tile->positions[b]) < range)
+            {
+                Constraint c = { 0 };
+                c.type = CONSTRAINT_SELF_COLLISION;
+                c.participants[0] = a;
+                c.participants[1] = b;
+                c.participantCount = 2;
+                arrput(tile->constraints, c);
+
+                if (b >= tile->ownedCount)
+                {
+                    c.participants[0] = b;
+                    c.participants[1] = a;
+                    arrput(tile->constraints, c);
+                }
+            }
+        }
+    }
+
+    // Project on the local copies. Corrections of ghost copies are discarded,
+    // the owning tile solves the same pair from its side.
+    for (size_t k = 0; k < arrlenu(tile->constraints); k++)
+    {
+        const Constraint *c = &tile->constraints[k];
+        const size_t i = c->participants[0];
+        const Vector2 pi = tile->positions[i];
+
+        if (c->type == CONSTRAINT_SURFACE_COLLISION)
+        {
+            tile->positions[i] = Vector2Add(pi, Vector2Scale(c->surfaceNormal,
+                -1.0f * Vector2DotProduct(Vector2Subtract(pi, c->entryPoint), c->surfaceNormal)));
+            continue;
+        }
+
+        const size_t j = c->participants[1];
+        const Vector2 pj = tile->positions[j];
+        const Vector2 seperation    = Vector2Subtract(pj, pi);
+        const Vector2 gradientC     = Vector2Normalize(seperation);
+        const float constraintEval  = Vector2Length(seperation) - (2.0f * PARTICLE_RADIUS);
+        const float iInvMass = tile->inverseMasses[i], jInvMass = tile->inverseMasses[j];
+        const float lambda = constraintEval / (iInvMass + jInvMass);
+
+        tile->positions[i] = Vector2Add(pi, Vector2Scale(gradientC, (lambda * iInvMass)));
+        tile->positions[j] = Vector2Add(pj, Vector2Scale(gradientC, (-1.0f * lambda * jInvMass)));
+    }
+}
+
+static void SolveDomainTileJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    const DomainJobContext *job = (const DomainJobContext*)context;
+    for (size_t t = begin; t < end; t++) { SolveDomainTile_(&job->domain->tiles[t], job->system, job->deltaTime); }
+}
+
+static void ScatterDomainTileJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    const DomainJobContext *job = (const DomainJobContext*)context;
+    ParticlePool *particles = job->system->particles_;
+    for (size_t t = begin; t < end; t++)
+    {
+        const DomainTile *tile = &job->domain->tiles[t];
+        for (size_t a = 0; a < tile->ownedCount; a++) { SetParticlePosition(particles, tile->particles[a], tile->positions[a]); }
+    }
+}
+
+Domain* ConstructDomain(uint32_t tileCount, float spacing)
+{
+    Domain *domain = (Domain*)TrackedMalloc(MEMORY_TAG_DOMAIN, sizeof(Domain));
+    PASSERT(domain, LOG_FATAL, "Failed to allocate domain decomposition");
+    if(!domain) { return NULL; }
+
+    PASSERT((tileCount > 0 && tileCount <= MAX_DOMAIN_TILES), LOG_WARNING,
+        "Domain tile count %u outside of [1, %d]. Clamping to valid range.", tileCount, MAX_DOMAIN_TILES);
+    domain->tileCount = (tileCount < 1) ? 1 : ((tileCount > MAX_DOMAIN_TILES) ? MAX_DOMAIN_TILES : tileCount);
+    domain->ghostWidth = 2.0f * PARTICLE_RADIUS;
+
+    for (uint32_t t = 0; t < MAX_DOMAIN_TILES; t++)
+    {
+        DomainTile *tile = &domain->tiles[t];
+        tile->xMin = tile->xMax = 0.0f;
+        tile->particles = NULL;
+        tile->ownedCount = 0;
+        tile->positions = NULL;
+        tile->inverseMasses = NULL;
+        tile->hash = (t < domain->tileCount) ? ConstructHash(spacing) : NULL;
+        tile->constraints = NULL;
+        tile->queryResults = NULL;
+    }
+
+    // Tile arrays grow on the worker threads, reserve them so they are
+    // accounted to the domain rather than to whichever tag a worker has set
+    MEMORY_SCOPE(MEMORY_TAG_DOMAIN)
+    {
+        for (uint32_t t = 0; t < domain->tileCount; t++)
+        {
+            DomainTile *tile = &domain->tiles[t];
+            arrsetcap(tile->particles, 64);
+            arrsetcap(tile->positions, 64);
+            arrsetcap(tile->inverseMasses, 64);
+            arrsetcap(tile->constraints, 64);
+            arrsetcap(tile->queryResults, 64);
+        }
+    }
+
+    return domain;
+}
+
+void DestructDomain(Domain *this)
+{
+    for (uint32_t t = 0; t < MAX_DOMAIN_TILES; t++)
+    {
+        DomainTile *tile = &this->tiles[t];
+        arrfree(tile->particles);
+        arrfree(tile->positions);
+        arrfree(tile->inverseMasses);
+        arrfree(tile->constraints);
+        arrfree(tile->queryResults);
+        if (tile->hash) { DestructHash(tile->hash); }
+    }
+    TrackedFree(this);
+}
+
+size_t SolveDomain(Domain *this, ParticleSystem *system, float deltaTime)
+{
+    AssignDomainTiles_(this, system);
+
+    // Every tile reads the shared pool while gathering, so no tile may write
+    // its owned particles back until all tiles finished solving.
+    DomainJobContext context = { this, system, deltaTime };
+    ParallelFor(system->jobs, this->tileCount, 1, SolveDomainTileJob_, &context);
+    ParallelFor(system->jobs, this->tileCount, 1, ScatterDomainTileJob_, &context);
+
+    // Count the contacts the global solver would generate, the reverse order
+    // of owned-ghost pairs is counted by the tile that owns the ghost
+    size_t contactCount = 0;
+    for (uint32_t t = 0; t < this->tileCount; t++)
+    {
+        const DomainTile *tile = &this->tiles[t];
+        for (size_t k = 0; k < arrlenu(tile->constraints); k++) { contactCount += (tile->constraints[k].participants[0] < tile->ownedCount); }
+    }
+    return contactCount;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include "raylib.h"
+
+#define MAX_DOMAIN_TILES 64
+
+// Forward declaration
+typedef struct Hash Hash;
+typedef struct ParticleSystem ParticleSystem;
+typedef struct Constraint Constraint;
+
+// Domain decomposition
+// -----------------
+// The boundary box is split into vertical strips. Each tile owns the particles
+// whose center lies inside its strip and keeps read-only ghost copies of the
+// neighbouring particles within one contact range of its borders. Tiles build
+// their own spatial hash, generate and project their own contacts on local
+// copies, and write back only the particles they own.
+typedef struct DomainTile
+{
+    float xMin, xMax;
+
+    size_t *particles;      // global particle indices, owned particles first then ghosts
+    size_t ownedCount;
+
+    Vector2 *positions;     // local copies indexed like particles
+    float *inverseMasses;
+
+    Hash *hash;
+    Constraint *constraints;    // participants are local indices
+    size_t *queryResults;
+}DomainTile;
+
+typedef struct Domain
+{
+    uint32_t tileCount;
+    float ghostWidth;
+    DomainTile tiles[MAX_DOMAIN_TILES];
+}Domain;
+
+typedef struct DomainJobContext
+{
+    Domain *domain;
+    ParticleSystem *system;
+    float deltaTime;
+}DomainJobContext;
+
+// Private methods
+// -----------------
+static void AssignDomainTiles_(Domain *this, const ParticleSystem *system);
+static void SolveDomainTile_(DomainTile *tile, const ParticleSystem *system, float deltaTime);
+static void SolveDomainTileJob_(void *context, size_t begin, size_t end, uint32_t workerIndex);
+static void ScatterDomainTileJob_(void *context, size_t begin, size_t end, uint32_t workerIndex);
+
+// Interface methods
+// -----------------
+Domain* ConstructDomain(uint32_t tileCount, float spacing);
+void DestructDomain(Domain *this);
+
+// Returns the number of contacts generated by all tiles
+size_t SolveDomain(Domain *this, ParticleSystem *system, float deltaTime);
@@ -5,28 +5,42 @@
 
 Hash* ConstructHash(float s)
 {
-    Hash *hash = (Hash*)malloc(sizeof(Hash));
+    Hash *hash = (Hash*)TrackedMalloc(MEMORY_TAG_HASH, sizeof(Hash));
+    PASSERTRETURNVALUE(hash, NULL, LOG_FATAL, "Failed to allocate spatial hash");
 
-    hash->isCleared = true;
-    hash->spacing   = s;
-    hash->tableSize = MAX_PARTICLE_COUNT;
+    InitHash(hash, s);
+    return hash;
+}
+
+void DestructHash(Hash *this)
+{
+    DestroyHash(this);
+    TrackedFree(this);
+}
 
-    for(size_t i = 0; i < hash->tableSize; i++)
+void InitHash(Hash *this, float s)
+{
+    this->isCleared = true;
+    this->spacing   = s;
+    this->tableSize = MAX_PARTICLE_COUNT;
+
+    for(size_t i = 0; i < this->tableSize; i++)
     {
-        hash->cellCount[i]  = 0;
-        hash->cellStart[i]  = 0;
-        hash->denseGrid[i]  = 0;
+        this->cellCount[i]  = 0;
+        this->cellStart[i]  = 0;
+        this->denseGrid[i]  = 0;
     }
 
-    hash->queryResults = NULL;
-    arrsetcap(hash->queryResults, hash->tableSize);
-
-    return hash;
+    this->queryResults = NULL;
+    MEMORY_SCOPE(MEMORY_TAG_QUERIES)
+    {
+        arrsetcap(this->queryResults, this->tableSize);
+    }
 }
 
-void DestructHash(Hash *this)
+void DestroyHash(Hash *this)
 {
-    free(this);
+    arrfree(this->queryResults);
 }
 
 void ClearHash(Hash *this)
@@ -45,13 +59,16 @@ void ClearHash(Hash *this)
 
 void FillHash(Hash *this, const ParticlePool *particles)
 {
-    PASSERT(this->isCleared, LOG_WARNING, "Spatial Hash Map not cleared, before filling. ");
-    if(!(this->isCleared)) { ClearHash(this); }
+    CalculatePoolHashCells(this, particles, 0, particles->activeCount);
+    FillHashFromCells(this, particles->activeCount);
+}
 
-    // count the total number of particles in each cell
-    for(size_t i = 0; i < particles->activeCount; i++)
+void CalculateHashCells(Hash *this, const Vector2 *positions, size_t begin, size_t end)
+{
+    // Independent per particle, so disjoint ranges may be computed concurrently.
+    for(size_t i = begin; i < end; i++)
     {
-        float x = particles->pPositions[i].x, y = particles->pPositions[i].y;
+        float x = positions[i].x, y = positions[i].y;
         // PASSERT((x > EPSILON && y > EPSILON), LOG_ERROR, "Particle position less than 0.");
 
         uint32_t cell = HashCoords_(
@@ -59,7 +76,34 @@ void FillHash(Hash *this, const ParticlePool *particles)
             CalculateCellCoord_(y, this->spacing),
             this->tableSize);
         PASSERT((cell >= 0 && cell < this->tableSize), LOG_ERROR, "Cell index out of range.");
-        this->cellCount[cell] += 1;
+        this->particleCells[i] = cell;
+    }
+}
+
+void CalculatePoolHashCells(Hash *this, const ParticlePool *particles, size_t begin, size_t end)
+{
+    // Same as CalculateHashCells, reading the pool in whatever layout it has
+    for(size_t i = begin; i < end; i++)
+    {
+        const Vector2 position = GetParticlePosition(particles, i);
+        uint32_t cell = HashCoords_(
+            CalculateCellCoord_(position.x, this->spacing),
+            CalculateCellCoord_(position.y, this->spacing),
+            this->tableSize);
+        PASSERT((cell >= 0 && cell < this->tableSize), LOG_ERROR, "Cell index out of range.");
+        this->particleCells[i] = cell;
+    }
+}
+
+void FillHashFromCells(Hash *this, size_t particleCount)
+{
+    PASSERT(this->isCleared, LOG_WARNING, "Spatial Hash Map not cleared, before filling. ");
+    if(!(this->isCleared)) { ClearHash(this); }
+
+    // count the total number of particles in each cell
+    for(size_t i = 0; i < particleCount; i++)
+    {
+        this->cellCount[this->particleCells[i]] += 1;
     }
 
     // Computing a running partial sum of the total number of particles in the
@@ -76,14 +120,9 @@ void FillHash(Hash *this, const ParticlePool *particles)
     // of each particle in the dense array of particles. When complete the cellStart 
     // array which previously contained the partial sums will contain the start index 
     // of cell in the dense array
-    for(size_t i = 0; i < particles->activeCount; i++)
+    for(size_t i = 0; i < particleCount; i++)
     {
-        uint32_t cell = HashCoords_(
-            CalculateCellCoord_(particles->pPositions[i].x, this->spacing),
-            CalculateCellCoord_(particles->pPositions[i].y, this->spacing),
-            this->tableSize);
-        PASSERT((cell >= 0 && cell < this->tableSize), LOG_ERROR, "Cell index out of range.");
-        size_t index = --(this->cellStart[cell]);
+        size_t index = --(this->cellStart[this->particleCells[i]]);
         this->denseGrid[index] = i;
     }
 
@@ -91,21 +130,31 @@ void FillHash(Hash *this, const ParticlePool *particles)
 }
 
 size_t QueryHashPoint(Hash *this, Vector2 position, float range)
+{
+    return QueryHashPointInto(this, position, range, &this->queryResults);
+}
+
+size_t QueryHashRange(Hash *this, float xMin, float xMax, float yMin, float yMax)
+{
+    return QueryHashRangeInto(this, xMin, xMax, yMin, yMax, &this->queryResults);
+}
+
+size_t QueryHashPointInto(const Hash *this, Vector2 position, float range, size_t **results)
 {
     int xMin = position.x - range;
     int yMin = position.y - range;
     int xMax = position.x + range;
     int yMax = position.y + range;
 
-    return QueryHashRange(this, xMin, xMax, yMin, yMax);
+    return QueryHashRangeInto(this, xMin, xMax, yMin, yMax, results);
 }
 
-size_t QueryHashRange(Hash *this, float xMin, float xMax, float yMin, float yMax)
+size_t QueryHashRangeInto(const Hash *this, float xMin, float xMax, float yMin, float yMax, size_t **results)
 {
     PASSERT((xMin <= xMax), LOG_WARNING, "Spatial hash query invalid range. x-max is less than x-min.");
     PASSERT((yMin <= yMax), LOG_WARNING, "Spatial hash query invalid range. y-max is less than y-min.");
 
-    arrsetlen(this->queryResults, 0);
+    arrsetlen(*results, 0);
 
     int x0 = CalculateCellCoord_(xMin, this->spacing);
     int y0 = CalculateCellCoord_(yMin, this->spacing);
@@ -126,9 +175,83 @@ size_t QueryHashRange(Hash *this, float xMin, float xMax, float yMin, float yMax
         
             for(size_t i = start; i < end; i++)
             {
-                arrput(this->queryResults, this->denseGrid[i]);
+                arrput(*results, this->denseGrid[i]);
             }
         }
     }
-    return arrlenu(this->queryResults);
+    return arrlenu(*results);
+}
+
+HashStats MeasureHash(const Hash *this, const ParticlePool *particles, size_t particleCount, float range, size_t **results)
+{
+    HashStats stats = { 0 };
+    stats.particleCount = particleCount;
+    PASSERTRETURNVALUE(!this->isCleared || particleCount == 0, stats, LOG_WARNING, "Measuring a spatial hash that is not filled.");
+
+    for (size_t h = 0; h < this->tableSize; h++)
+    {
+        const size_t count = this->cellCount[h];
+        if (count == 0) { continue; }
+
+        stats.occupiedSlots++;
+        if (count > stats.maxPerSlot) { stats.maxPerSlot = count; }
+
+        // Distinct grid cells in the slot. Slots hold few particles, so a
+        // quadratic scan is cheaper than any set.
+        size_t cells = 0;
+        const size_t start = this->cellStart[h];
+        for (size_t i = start; i < start + count; i++)
+        {
+            const Vector2 p = GetParticlePosition(particles, this->denseGrid[i]);
+            const int xi = CalculateCellCoord_(p.x, this->spacing), yi = CalculateCellCoord_(p.y, this->spacing);
+
+            bool isSeen = false;
+            for (size_t j = start; j < i && !isSeen; j++)
+            {
+                const Vector2 q = GetParticlePosition(particles, this->denseGrid[j]);
+                isSeen = (CalculateCellCoord_(q.x, this->spacing) == xi) && (CalculateCellCoord_(q.y, this->spacing) == yi);
+            }
+            if (!isSeen) { cells++; }
+        }
+        stats.occupiedCells += cells;
+        if (cells > 1) { stats.collidingSlots++; }
+    }
+    stats.meanPerSlot = (stats.occupiedSlots > 0) ? ((float)particleCount / (float)stats.occupiedSlots) : 0.0f;
+
+    for (size_t i = 0; i < particleCount; i++)
+    {
+        const Vector2 position = GetParticlePosition(particles, i);
+        const size_t candidateCount = QueryHashPointInto(this, position, range, results);
+        stats.queryCandidates += candidateCount;
+        for (size_t k = 0; k < candidateCount; k++)
+        {
+            if (Vector2Distance(position, GetParticlePosition(particles, (*results)[k])) < range) { stats.queryNeighbors++; }
+        }
+    }
+
+    return stats;
+}
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawHashHeatmap(const uint32_t *slotCounts, uint32_t tableSize, float spacing, Rectangle view)
+{
+    if (view.width <= 0.0f || view.height <= 0.0f) { return; }
+
+    const int x0 = CalculateCellCoord_(view.x, spacing), x1 = CalculateCellCoord_(view.x + view.width, spacing);
+    const int y0 = CalculateCellCoord_(view.y, spacing), y1 = CalculateCellCoord_(view.y + view.height, spacing);
+
+    // Green for one particle, red at eight or more. Empty cells stay clear.
+    for (int xi = x0; xi <= x1; xi++)
+    {
+        for (int yi = y0; yi <= y1; yi++)
+        {
+            const uint32_t count = slotCounts[HashCoords_(xi, yi, tableSize)];
+            if (count == 0) { continue; }
+
+            const float load = Clamp((float)(count - 1) / 7.0f, 0.0f, 1.0f);
+            const Color color = ColorLerp(GREEN, RED, load);
+            DrawRectangleV((Vector2){ xi * spacing, yi * spacing }, (Vector2){ spacing, spacing }, Fade(color, 0.35f));
+        }
+    }
 }
+#endif
@@ -8,19 +8,36 @@
 // Forward declaration
 typedef struct ParticlePool ParticlePool; 
 
+// Tables first, so a cache line aligned hash has cache line aligned tables
 typedef struct Hash
 {
-    bool isCleared;
-    float spacing;
-    uint32_t tableSize;
-
     uint32_t cellCount[MAX_PARTICLE_COUNT];
     size_t cellStart[MAX_PARTICLE_COUNT];
     size_t denseGrid[MAX_PARTICLE_COUNT];
+    uint32_t particleCells[MAX_PARTICLE_COUNT];  // hashed cell of each particle
+
+    bool isCleared;
+    float spacing;
+    uint32_t tableSize;
 
     size_t *queryResults;
 }Hash;
 
+// Diagnostics of one filled hash. A slot is one entry of the hash table, a
+// cell is one square of the spacing sized grid. Distinct cells hashing to the
+// same slot are collisions and show up as extra query candidates.
+typedef struct HashStats
+{
+    size_t particleCount;
+    size_t occupiedSlots;
+    size_t maxPerSlot;
+    float meanPerSlot;          // particles per occupied slot
+    size_t occupiedCells;
+    size_t collidingSlots;      // slots shared by more than one grid cell
+    size_t queryCandidates;     // particles returned by one point query per particle
+    size_t queryNeighbors;      // candidates actually within the query range
+}HashStats;
+
 // Private methods
 // -----------------
 static inline int CalculateCellCoord_(float coord, float spacing)
@@ -37,8 +54,24 @@ static inline size_t HashCoords_(int xi, int yi, uint32_t tableSize)
 // -----------------
 Hash* ConstructHash(float s);
 void DestructHash(Hash *this);
+void InitHash(Hash *this, float s);     // in place, for hashes embedded in a larger block
+void DestroyHash(Hash *this);           // frees what InitHash allocated, not the hash itself
 
 void ClearHash(Hash *this);
 void FillHash(Hash *this, const ParticlePool *particles);
+void CalculateHashCells(Hash *this, const Vector2 *positions, size_t begin, size_t end);
+void CalculatePoolHashCells(Hash *this, const ParticlePool *particles, size_t begin, size_t end);
+void FillHashFromCells(Hash *this, size_t particleCount);
+
 size_t QueryHashPoint(Hash *this, Vector2 position, float range);
-size_t QueryHashRange(Hash *this, float xMin, float xMax, float yMin, float yMax);
\ No newline at end of file
+size_t QueryHashRange(Hash *this, float xMin, float xMax, float yMin, float yMax);
+size_t QueryHashPointInto(const Hash *this, Vector2 position, float range, size_t **results);
+size_t QueryHashRangeInto(const Hash *this, float xMin, float xMax, float yMin, float yMax, size_t **results);
+
+// The pool must be the one the hash was filled from
+HashStats MeasureHash(const Hash *this, const ParticlePool *particles, size_t particleCount, float range, size_t **results);
+
+#if !defined(PARTICLE_HEADLESS)
+// Draws the particle count of the slot each grid cell in view hashes to
+void DrawHashHeatmap(const uint32_t *slotCounts, uint32_t tableSize, float spacing, Rectangle view);
+#endif
\ No newline at end of file
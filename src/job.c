@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "job.h"
+#include "trace.h"
+
+#include <stdio.h>
+
+static bool TakeChunk_(JobWorker *worker, bool fromBack, uint32_t *chunk)
+{
+    uint64_t range = atomic_load_explicit(&worker->chunks, memory_order_relaxed);
+    for (;;)
+    {
+        const uint32_t begin = (uint32_t)(range >> 32), end = (uint32_t)range;
+        if (begin >= end) { return false; }
+
+        const uint64_t next = fromBack ?
+            (((uint64_t)begin << 32) | (end - 1)) :
+            (((uint64_t)(begin + 1) << 32) | end);
+        if (atomic_compare_exchange_weak_explicit(&worker->chunks, &range, next,
+                memory_order_acq_rel, memory_order_relaxed))
+        {
+            *chunk = fromBack ? (end - 1) : begin;
+            return true;
+        }
+    }
+}
+
+static void RunChunks_(JobSystem *this, uint32_t workerIndex)
+{
+    uint32_t chunk;
+    for (;;)
+    {
+        // Drain the worker's own range first, then steal from the back of the
+        // other workers' ranges.
+        bool found = TakeChunk_(&this->workers[workerIndex], false, &chunk);
+        for (uint32_t k = 1; !found && k < this->threadCount; k++)
+        {
+            found = TakeChunk_(&this->workers[(workerIndex + k) % this->threadCount], true, &chunk);
+        }
+        if (!found) { return; }
+
+        const size_t begin = (size_t)chunk * this->grainSize;
+        const size_t end = (begin + this->grainSize < this->count) ? (begin + this->grainSize) : this->count;
+        this->fn(this->context, begin, end, workerIndex);
+    }
+}
+
+static void WorkerMain_(void *argument)
+{
+    JobWorker *worker = (JobWorker*)argument;
+    JobSystem *jobs = worker->jobs;
+    uint64_t generation = 0;
+
+#if defined(PARTICLE_PROFILE)
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", worker->index);
+    SetTraceThreadName(name);
+#endif
+
+    LockMutex(&jobs->mutex);
+    for (;;)
+    {
+        while (jobs->isRunning && jobs->generation == generation) { WaitCondition(&jobs->wake, &jobs->mutex); }
+        if (!jobs->isRunning) { break; }
+        generation = jobs->generation;
+        UnlockMutex(&jobs->mutex);
+
+        TRACE_SCOPE("parallel for")
+        {
+            RunChunks_(jobs, worker->index);
+        }
+
+        LockMutex(&jobs->mutex);
+        if (--jobs->pendingWorkers == 0) { SignalCondition(&jobs->done); }
+    }
+    UnlockMutex(&jobs->mutex);
+}
+
+JobSystem* ConstructJobSystem(uint32_t threadCount)
+{
+    JobSystem *jobs = (JobSystem*)TrackedMalloc(MEMORY_TAG_SYSTEM, sizeof(JobSystem));
+    PASSERT(jobs, LOG_FATAL, "Failed to allocate job system");
+    if(!jobs) { return NULL; }
+
+    if (threadCount == 0) { threadCount = GetHardwareThreadCount(); }
+    PASSERT(threadCount <= MAX_JOB_THREADS, LOG_WARNING,
+        "Job thread count %u exceeds MAX_JOB_THREADS. Clamping to %d.", threadCount, MAX_JOB_THREADS);
+    jobs->threadCount = (threadCount < MAX_JOB_THREADS) ? threadCount : MAX_JOB_THREADS;
+
+    InitMutex(&jobs->mutex);
+    InitCondition(&jobs->wake);
+    InitCondition(&jobs->done);
+    jobs->isRunning = true;
+    jobs->generation = 0;
+    jobs->pendingWorkers = 0;
+
+    jobs->fn = NULL;
+    jobs->context = NULL;
+    jobs->count = 0;
+    jobs->grainSize = 1;
+
+    // Worker 0 is the thread calling ParallelFor
+    for (uint32_t i = 0; i < jobs->threadCount; i++)
+    {
+        jobs->workers[i].jobs = jobs;
+        jobs->workers[i].index = i;
+        atomic_init(&jobs->workers[i].chunks, 0);
+
+        if (i == 0) { continue; }
+        if (!StartThread(&jobs->workers[i].thread, WorkerMain_, &jobs->workers[i]))
+        {
+            TraceLog(LOG_WARNING, "Failed to start job worker %u. Running with %u threads.", i, i);
+            jobs->threadCount = i;
+            break;
+        }
+    }
+
+    return jobs;
+}
+
+void DestructJobSystem(JobSystem *this)
+{
+    LockMutex(&this->mutex);
+    this->isRunning = false;
+    BroadcastCondition(&this->wake);
+    UnlockMutex(&this->mutex);
+
+    for (uint32_t i = 1; i < this->threadCount; i++) { JoinThread(&this->workers[i].thread); }
+
+    DestroyCondition(&this->wake);
+    DestroyCondition(&this->done);
+    DestroyMutex(&this->mutex);
+    TrackedFree(this);
+}
+
+void ParallelFor(JobSystem *this, size_t count, size_t grainSize, ParallelForFn fn, void *context)
+{
+    if (count == 0) { return; }
+    if (grainSize == 0) { grainSize = 1; }
+
+    // Serial fallback
+    if (!this || this->threadCount <= 1 || count <= grainSize)
+    {
+        fn(context, 0, count, 0);
+        return;
+    }
+
+    const size_t chunkCount = (count + grainSize - 1) / grainSize;
+    PASSERT(chunkCount <= UINT32_MAX, LOG_ERROR, "Parallel-for chunk count exceeds 32 bits.");
+
+    // Give each worker an even, contiguous share of the chunks
+    for (uint32_t i = 0; i < this->threadCount; i++)
+    {
+        const uint64_t begin = (chunkCount * i) / this->threadCount;
+        const uint64_t end = (chunkCount * (i + 1)) / this->threadCount;
+        atomic_store_explicit(&this->workers[i].chunks, (begin << 32) | end, memory_order_relaxed);
+    }
+
+    LockMutex(&this->mutex);
+    this->fn = fn;
+    this->context = context;
+    this->count = count;
+    this->grainSize = grainSize;
+    this->pendingWorkers = this->threadCount - 1;
+    this->generation++;
+    BroadcastCondition(&this->wake);
+    UnlockMutex(&this->mutex);
+
+    TRACE_SCOPE("parallel for")
+    {
+        RunChunks_(this, 0);
+    }
+
+    LockMutex(&this->mutex);
+    while (this->pendingWorkers > 0) { WaitCondition(&this->done, &this->mutex); }
+    UnlockMutex(&this->mutex);
+}
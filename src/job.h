@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "platform.h"
+
+#define MAX_JOB_THREADS 64
+
+// Forward declaration
+typedef struct JobSystem JobSystem;
+
+// Called with a half-open index range [begin, end). `workerIndex` identifies the
+// thread executing the range and is always less than the job system's threadCount.
+typedef void (*ParallelForFn)(void *context, size_t begin, size_t end, uint32_t workerIndex);
+
+// Jobs
+// -----------------
+typedef struct JobWorker
+{
+    JobSystem *jobs;
+    uint32_t index;
+    Thread thread;
+
+    // Chunk range still owned by this worker packed as (begin << 32 | end).
+    // The owner takes chunks from the front, thieves take them from the back.
+    _Atomic uint64_t chunks;
+}JobWorker;
+
+struct JobSystem
+{
+    uint32_t threadCount;   // including the calling thread
+    JobWorker workers[MAX_JOB_THREADS];
+
+    Mutex mutex;
+    Condition wake;
+    Condition done;
+    bool isRunning;
+    uint64_t generation;
+    uint32_t pendingWorkers;
+
+    // Active parallel-for
+    ParallelForFn fn;
+    void *context;
+    size_t count;
+    size_t grainSize;
+};
+
+// Private methods
+// -----------------
+static bool TakeChunk_(JobWorker *worker, bool fromBack, uint32_t *chunk);
+static void RunChunks_(JobSystem *this, uint32_t workerIndex);
+static void WorkerMain_(void *argument);
+
+// Interface methods
+// -----------------
+JobSystem* ConstructJobSystem(uint32_t threadCount);
+void DestructJobSystem(JobSystem *this);
+
+static inline uint32_t GetJobThreadCount(const JobSystem *this) { return this ? this->threadCount : 1; }
+
+void ParallelFor(JobSystem *this, size_t count, size_t grainSize, ParallelForFn fn, void *context);
@@ -1,5 +1,10 @@
 #include "pch.h"
 #include "particle.h"
+#include "collider.h"
+#include "job.h"
+#include "simulation.h"
+#include "renderer.h"
+#include "profiler.h"
 #include "resource_dir.h"	// utility header for SearchAndSetResourceDir
 
 // ------------------------
@@ -28,57 +33,116 @@ int main ()
 
     // Initialize particle system
     ParticleSystem *particleSystem = ConstructParticleSystem(0, screenWidth, 0, screenHeight);
-    ParticleEmitter *emitter = &particleSystem->emitter;
+    JobSystem *jobs = ConstructJobSystem(JOB_THREAD_COUNT);
+    SetJobSystem(particleSystem, jobs);
     AddForce(particleSystem, 
         (Force){FORCE_GRAVITY, 0.0f, (Vector2){screenWidth * 0.25f, screenHeight * 0.5f}, 50.0f });
     AddForce(particleSystem, 
         (Force){FORCE_VISCOUS, AIR_VISCOSITY, (Vector2){screenWidth * 0.25f, screenHeight * 0.5f}, 50.0f });
+
+    // Static level geometry
+    const Vector2 ramp[] = {
+        { screenWidth * 0.10f, screenHeight * 0.40f },
+        { screenWidth * 0.35f, screenHeight * 0.55f },
+        { screenWidth * 0.45f, screenHeight * 0.55f },
+    };
+    AddPolylineCollider(particleSystem->colliders, ramp, sizeof(ramp) / sizeof(Vector2), false);
+    AddCircleCollider(particleSystem->colliders, (Vector2){ screenWidth * 0.70f, screenHeight * 0.65f }, 40.0f);
+    BuildColliderSet(particleSystem->colliders);
+
     // AddForce(particleSystem, 
     //     (Force){FORCE_REPULSE, 0.0f, (Vector2){screenWidth * 0.25f, screenHeight * 0.5f}, 5.0e5 });
     // AddForce(particleSystem, 
     //     (Force){FORCE_REPULSE, 0.0f, (Vector2){screenWidth * 0.75f, screenHeight * 0.5f}, 5.0e5 });
 
-    // // Set up vertex data
-    // float quadVertices [] = {
-    //     // positions
-    //     0.71f,  0.71f,
-    //     -0.71f,  0.71f,
-    //     -0.71f, -0.71f,
-        
-    //     0.71f, -0.71f,
-    //     0.71f, -0.71f,
-    //     0.71f,  0.71f,
-    // };
-    // uint32_t quadVAO, quadVBO;
-    // quadVAO = rlLoadVertexArray();
-    // quadVBO = rlLoadVertexBuffer(&quadVertices, sizeof(quadVertices) / sizeof(float), false);
-    // rlEnableVertexAttribute(0);
-    // rlSetVertexAttribute(0, 2, RL_FLOAT, false, 2 * sizeof(float), 0);
+    // Utility function from resource_dir.h to find the resources folder and set it as the current working directory so we can load from it
+    SearchAndSetResourceDir("resources");
 
-    // uint32_t instancePositionVBO;
-    // instancePositionVBO = rlLoadVertexBuffer(&particleSystem->particles_->pPositions, sizeof(particleSystem->particles_->pPositions) / sizeof(Vector2), false);
+    ParticleRenderer *renderer = ConstructParticleRenderer("shaders/particle.vs", "shaders/particle.fs");
 
-    // // Utility function from resource_dir.h to find the resources folder and set it as the current working directory so we can load from it
-    // SearchAndSetResourceDir("resources");
+    // From here on the simulation thread owns the particle system, the loop
+    // below reads only published snapshots
+    SimulationThread *simulation = ConstructSimulationThread(particleSystem, SIMULATION_STEP_RATE);
 
-    // Shader particleShader = LoadShader("shaders/particle.vs", "shaders/particle.fs");
+#if defined(PARTICLE_PROFILE)
+    Profiler *profiler = ConstructProfiler();
+    SetTraceThreadName("main");
+#endif
+    bool isShowingMemory = false;
 
     // Main game loop
     while (!WindowShouldClose())        // run the loop until the user presses ESCAPE or presses the Close button on the window
     {
         // Update
         // -----------------------
-        float deltaTime = GetFrameTime();
-        
+        // The particle system is owned by the simulation thread from here on.
+        // Input is forwarded as commands and drawing reads the latest snapshot.
+        const Vector2 mouseWorld = GetScreenToWorld2D(GetMousePosition(), camera);
         if(IsMouseButtonDown(MOUSE_BUTTON_LEFT)) 
         {
-            Vector2 pos = Vector2Add(emitter->position, 
-                            Vector2Scale((Vector2){ GetRandomValueF(), GetRandomValueF() }, emitter->radius));
-            EmitParticle(particleSystem, pos, &defaultParticleProps);
+            PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_EMIT, mouseWorld });
+        }
+
+        // Zoom around the cursor
+        const float wheel = GetMouseWheelMove();
+        if(wheel != 0.0f)
+        {
+            camera.offset = GetMousePosition();
+            camera.target = mouseWorld;
+            camera.zoom = Clamp(camera.zoom * expf(0.1f * wheel), 0.02f, 8.0f);
         }
         
-        emitter->position = GetMousePosition();
-        UpdateParticles(particleSystem, deltaTime);
+        // Toggle between boundary geometry and the baked collision field
+        if(IsKeyPressed(KEY_F))
+        {
+            PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_TOGGLE_COLLISION_FIELD });
+        }
+
+        if(IsKeyPressed(KEY_W))
+        {
+            PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_TOGGLE_WALL_HANDLER });
+        }
+
+        // Toggle the tiled domain decomposition solver
+        if(IsKeyPressed(KEY_D))
+        {
+            PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_TOGGLE_DOMAIN_DECOMPOSITION });
+        }
+
+        // Spatial hash statistics and slot heatmap
+        if(IsKeyPressed(KEY_H))
+        {
+            PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_TOGGLE_HASH_DIAGNOSTICS });
+        }
+
+        // Memory usage per subsystem
+        if(IsKeyPressed(KEY_M)) { isShowingMemory = !isShowingMemory; }
+
+#if defined(PARTICLE_PROFILE)
+        // Stream per frame phase times to CSV
+        if(IsKeyPressed(KEY_C))
+        {
+            if(IsProfileCsvOpen(profiler)) { StopProfileCsv(profiler); }
+            else { StartProfileCsv(profiler, "profile.csv"); }
+        }
+
+        // Record a Chrome trace, written out when recording stops
+        if(IsKeyPressed(KEY_T))
+        {
+            if(IsTraceRecording()) { StopTrace(); FlushTrace("trace.json"); }
+            else { StartTrace(); }
+        }
+#endif
+
+        PushSimulationCommand(simulation, (SimulationCommand){ SIM_COMMAND_MOVE_EMITTER, mouseWorld });
+        const RenderSnapshot *snapshot = AcquireRenderSnapshot(simulation);
+
+#if defined(PARTICLE_PROFILE)
+        // Simulation phases of the displayed step, render is timed below
+        double phaseTimes[PROFILE_PHASE_COUNT];
+        memcpy(phaseTimes, snapshot->stats.phaseTimes, sizeof(phaseTimes));
+        phaseTimes[PROFILE_PHASE_RENDER] = 0.0;
+#endif
 
         // Drawing
         // ------------------------
@@ -99,33 +163,86 @@ int main ()
                 rlPopMatrix();
 
                 // draw emitor at cursor position
-                DrawCircleV(particleSystem->emitter.position, particleSystem->emitter.radius, BLUE);
+                DrawCircleV(snapshot->emitterPosition, snapshot->emitterRadius, BLUE);
 
-                // BeginShaderMode(particleShader);
-                // {
-                //     DrawParticles(particleSystem);
-                // }
-                // EndShaderMode();
+                if(snapshot->isMeasuringHash)
+                {
+                    // Only the part of the boundary box in view
+                    const Vector2 viewMin = GetScreenToWorld2D((Vector2){ 0, 0 }, camera);
+                    const Vector2 viewMax = GetScreenToWorld2D((Vector2){ (float)GetScreenWidth(), (float)GetScreenHeight() }, camera);
+                    const Rectangle view = GetCollisionRec(
+                        (Rectangle){ viewMin.x, viewMin.y, viewMax.x - viewMin.x, viewMax.y - viewMin.y },
+                        (Rectangle){ 0, 0, (float)screenWidth, (float)screenHeight });
+                    DrawHashHeatmap(snapshot->hashSlotCounts, snapshot->hashTableSize, snapshot->hashSpacing, view);
+                }
 
-                DrawParticles(particleSystem);
-                DrawForces(particleSystem);
+                DrawColliders(snapshot->colliders, snapshot->colliderCount);
+                PROFILE_SCOPE(phaseTimes, PROFILE_PHASE_RENDER)
+                {
+                    DrawRenderSnapshot(snapshot, renderer, camera, GetRenderSnapshotAlpha(snapshot, GetPlatformTime()));
+                }
+                DrawForces(snapshot->forces, snapshot->forceCount);
             }
             EndMode2D();
             
             // Draw UI elements
-            DrawRectangle(5, 10, 320, 93, Fade(SKYBLUE, 0.5f));
-            DrawRectangleLines(5, 10, 320, 93, BLUE);
+            const MemoryStats memory = GetMemoryStats();
+            DrawRectangle(5, 10, 320, 143, Fade(SKYBLUE, 0.5f));
+            DrawRectangleLines(5, 10, 320, 143, BLUE);
             DrawText(TextFormat("FPS: %i ", GetFPS()), 10, 10, 10, DARKGRAY);
             DrawText(TextFormat("Frame time: %02.02f ms", GetFrameTime()), 10, 20, 10, DARKGRAY);
-            DrawText(TextFormat("Particle count: %i", particleSystem->particles_->activeCount), 10, 30, 10, DARKGRAY);
-            DrawText(TextFormat("Emitter Coords: (%02.02f, %02.02f)", emitter->position.x, emitter->position.y), 10, 40, 10, DARKGRAY);
+            DrawText(TextFormat("Particle count: %i", (int)snapshot->activeCount), 10, 30, 10, DARKGRAY);
+            DrawText(TextFormat("Emitter Coords: (%02.02f, %02.02f)", snapshot->emitterPosition.x, snapshot->emitterPosition.y), 10, 40, 10, DARKGRAY);
+            DrawText(TextFormat("Collision mode [F]: %s", (snapshot->collisionMode == COLLISION_MODE_FIELD) ? "field" : "geometry"), 10, 50, 10, DARKGRAY);
+            DrawText(TextFormat("Wall handler [W]: %s", (snapshot->wallHandler == WALL_HANDLER_CLAMP) ? "clamp" : "hash query"), 10, 60, 10, DARKGRAY);
+            DrawText(TextFormat("Wall contacts: %i", (int)snapshot->stats.wallContactCount), 10, 70, 10, DARKGRAY);
+            DrawText(TextFormat("Sim step %i: %02.03f ms (%i dropped)", (int)snapshot->step, snapshot->stepTime * 1000.0, (int)snapshot->droppedSteps), 10, 80, 10, DARKGRAY);
+            DrawText(TextFormat("Domain tiles [D]: %i", (int)snapshot->domainTileCount), 10, 90, 10, DARKGRAY);
+            DrawText(TextFormat("Renderer: %s, %i drawn (zoom %02.02f)", renderer->stats.isSplatting ? "cell splats" :
+                (renderer->isInstanced ? "instanced" : "immediate"),
+                (int)(renderer->stats.isSplatting ? renderer->stats.drawnCells : renderer->stats.drawnInstances), camera.zoom), 10, 100, 10, DARKGRAY);
+            if(snapshot->isMeasuringHash)
+            {
+                const HashStats *hash = &snapshot->stats.hash;
+                DrawText(TextFormat("Hash [H]: %i slots (%i colliding), %02.02f mean, %i max", (int)hash->occupiedSlots,
+                    (int)hash->collidingSlots, hash->meanPerSlot, (int)hash->maxPerSlot), 10, 110, 10, DARKGRAY);
+                DrawText(TextFormat("Hash query: %02.02f candidates per neighbor", (hash->queryNeighbors > 0) ?
+                    ((float)hash->queryCandidates / (float)hash->queryNeighbors) : 0.0f), 10, 120, 10, DARKGRAY);
+            }
+            else
+            {
+                DrawText("Hash [H]: off", 10, 110, 10, DARKGRAY);
+            }
+            DrawText(TextFormat("Memory [M]: %02.02f MiB (peak %02.02f), %i heap ops/step", memory.totalBytes / (1024.0 * 1024.0),
+                memory.totalPeakBytes / (1024.0 * 1024.0), (int)(snapshot->stats.allocationCount + snapshot->stats.reallocationCount)),
+                10, 130, 10, DARKGRAY);
+
+#if defined(PARTICLE_PROFILE)
+            RecordProfileFrame(profiler, phaseTimes);
+            DrawProfilerOverlay(profiler, GetScreenWidth() - 265, 10);
+            const int memoryOverlayY = 10 + ((PROFILE_PHASE_COUNT + 1) * 10) + 6 + 5;
+#else
+            const int memoryOverlayY = 10;
+#endif
+            if(isShowingMemory)
+            {
+                DrawMemoryOverlay(&memory, snapshot->stats.allocationCount, snapshot->stats.reallocationCount,
+                    GetScreenWidth() - 265, memoryOverlayY);
+            }
         }
         // end the frame and get ready for the next one  (display frame, poll input, etc...)
         EndDrawing();
     }
     // De-Initialization
     // ------------------------
+    DestructSimulationThread(simulation);
     DestructParticleSystem(particleSystem);
+    DestructJobSystem(jobs);
+    DestructParticleRenderer(renderer);
+#if defined(PARTICLE_PROFILE)
+    DestructProfiler(profiler);
+    ShutdownTrace();
+#endif
     // destroy the window and cleanup the OpenGL context
     CloseWindow();
     return 0;
@@ -1,62 +1,85 @@
 #include "pch.h"
 #include "particle.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define PARTICLE_SSE2
+#endif
+
 #include "hash.h"
+#include "collider.h"
+#include "sdf.h"
+#include "job.h"
+#include "domain.h"
+#include "simd.h"
 
 ParticleProps defaultParticleProps = {
     0.5f,                   // varaince
     10.0f,                  // lifetime
     { -500.0f, 0.0f },        // velocity
     10.0f,                  // mass
-    { 230, 41, 55, 255 },   // birthColor
-    { 255, 161, 0, 0 },     // deathColor
+    WATER,                  // type
+};
+
+ParticlePalette particlePalettes[PARTICLE_TYPE_COUNT] = {
+    { { 230, 41, 55, 255 }, { 255, 161, 0, 0 } },       // WATER
+    { { 194, 178, 128, 255 }, { 130, 110, 70, 0 } },    // SAND
 };
 
-static ParticlePool* ConstructParticlePool_() 
+const char *forceSetNames[FORCE_SET_COUNT] = {
+    "none",
+    "gravity",
+    "gravity_viscous",
+    "gravity_viscous_points",
+    "generic",
+};
+
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+    const char *particleLayoutName = "soa";
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_SPLIT
+    const char *particleLayoutName = "split";
+#else
+    const char *particleLayoutName = "aosoa";
+#endif
+
+static size_t AlignCacheLine_(size_t size)
 {
-    ParticlePool *particles = (ParticlePool*)malloc(sizeof(ParticlePool));
-    PASSERT(particles, LOG_FATAL, "Failed to allocate particle particles");
-    if(!particles) { return NULL; }
+    return (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
 
+static void InitParticlePool_(ParticlePool *particles) 
+{
     particles->activeCount = 0;
 
     for (int i = 0; i < MAX_PARTICLE_COUNT; i++) 
     {
-        particles->pLifetimes[i]  = 0.0f;
-        particles->pLifespans[i]  = 0.0f;
+        PARTICLE_LIFETIME(particles, i) = 0.0f;
+        PARTICLE_LIFESPAN(particles, i) = 0.0f;
 
-        particles->pPrevPositions[i] = (Vector2){ 0 };
-        particles->pPositions[i]     = (Vector2){ 0 };
-        particles->pVelocities[i]    = (Vector2){ 0 };
+        SetParticlePrevPosition(particles, i, (Vector2){ 0 });
+        SetParticleStepPosition(particles, i, (Vector2){ 0 });
+        SetParticlePosition(particles, i, (Vector2){ 0 });
+        SetParticleVelocity(particles, i, (Vector2){ 0 });
 
-        particles->pMasses[i]  = 0.0f;
+        PARTICLE_MASS(particles, i) = 0.0f;
 
-        particles->pBirthColors[i]    = (Color){ 0 };
-        particles->pDeathColors[i]    = (Color){ 0 };
-        particles->pColors[i]  = (Color){ 0 };
+        PARTICLE_TYPE(particles, i) = WATER;
     }
-    return particles;
-}
-
-static void DestructParticlePool_(ParticlePool *particles) 
-{
-    free(particles);
 }
 
 static void SwapParticles_(ParticlePool *particles, size_t i, size_t j)
 {
-    particles->pLifetimes[i]      = particles->pLifetimes[j];
-    particles->pLifespans[i]      = particles->pLifespans[j];
+    PARTICLE_LIFETIME(particles, i) = PARTICLE_LIFETIME(particles, j);
+    PARTICLE_LIFESPAN(particles, i) = PARTICLE_LIFESPAN(particles, j);
 
-    particles->pPrevPositions[i] = particles->pPrevPositions[j];
-    particles->pPositions[i]     = particles->pPositions[j];
-    particles->pVelocities[i]    = particles->pVelocities[j];
+    SetParticlePrevPosition(particles, i, GetParticlePrevPosition(particles, j));
+    SetParticleStepPosition(particles, i, GetParticleStepPosition(particles, j));
+    SetParticlePosition(particles, i, GetParticlePosition(particles, j));
+    SetParticleVelocity(particles, i, GetParticleVelocity(particles, j));
 
-    particles->pMasses[i]        = particles->pMasses[j];
+    PARTICLE_MASS(particles, i) = PARTICLE_MASS(particles, j);
 
-    particles->pBirthColors[i]   = particles->pBirthColors[j];
-    particles->pDeathColors[i]   = particles->pDeathColors[j];
-    particles->pColors[i]        = particles->pColors[j];
+    PARTICLE_TYPE(particles, i) = PARTICLE_TYPE(particles, j);
 }
 
 static void KillParticle_(ParticlePool *particles, size_t index) 
@@ -65,28 +88,106 @@ static void KillParticle_(ParticlePool *particles, size_t index)
     SwapParticles_(particles, index, particles->activeCount);
 }
 
+static void CopyStepPositions_(ParticlePool *particles)
+{
+    const size_t n = particles->activeCount;
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+    memcpy(particles->pStepPositions, particles->pPositions, sizeof(Vector2) * n);
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_SPLIT
+    memcpy(particles->pStepPositionsX, particles->pPositionsX, sizeof(float) * n);
+    memcpy(particles->pStepPositionsY, particles->pPositionsY, sizeof(float) * n);
+#else
+    // Whole blocks, the lanes past the active count are never read
+    for (size_t b = 0; b < (n + PARTICLE_BLOCK_SIZE - 1) / PARTICLE_BLOCK_SIZE; b++)
+    {
+        ParticleBlock *block = &particles->pBlocks[b];
+        memcpy(block->pStepPositionsX, block->pPositionsX, sizeof(block->pPositionsX));
+        memcpy(block->pStepPositionsY, block->pPositionsY, sizeof(block->pPositionsY));
+    }
+#endif
+}
+
+static ParticleScratch ConstructParticleScratch_()
+{
+    // Reserved here so that growth on the worker threads keeps the tags
+    ParticleScratch scratch = { 0 };
+    MEMORY_SCOPE(MEMORY_TAG_QUERIES)
+    {
+        arrsetcap(scratch.queryResults, 64);
+    }
+    MEMORY_SCOPE(MEMORY_TAG_CONSTRAINTS)
+    {
+        arrsetcap(scratch.constraints, 64);
+    }
+    return scratch;
+}
+
+static void FreeParticleScratch_(ParticleScratch *scratch)
+{
+    for (size_t w = 0; w < arrlenu(scratch); w++)
+    {
+        arrfree(scratch[w].queryResults);
+        arrfree(scratch[w].constraints);
+    }
+    arrfree(scratch);
+}
+
+static void ResetFrameScratch_(ParticleSystem *system)
+{
+    // Release the buffers while the arena still holds them, reset the arena
+    // and reserve them again. Growth past the arena during an update falls
+    // back to the heap, the arena catches up to it on the next reset.
+    ParticleScratch *buffers[2] = { system->scratch_, system->chunkScratch_ };
+    for (int b = 0; b < 2; b++)
+    {
+        for (size_t w = 0; w < arrlenu(buffers[b]); w++)
+        {
+            ParticleScratch *scratch = &buffers[b][w];
+            scratch->queryCapacity = arrcap(scratch->queryResults);
+            scratch->constraintCapacity = arrcap(scratch->constraints);
+            arrfree(scratch->queryResults);
+            arrfree(scratch->constraints);
+        }
+    }
+
+    ResetArena(system->frameArena_);
+
+    ARENA_SCOPE(system->frameArena_)
+    {
+        for (int b = 0; b < 2; b++)
+        {
+            for (size_t w = 0; w < arrlenu(buffers[b]); w++)
+            {
+                ParticleScratch *scratch = &buffers[b][w];
+                arrsetcap(scratch->queryResults, scratch->queryCapacity);
+                arrsetcap(scratch->constraints, scratch->constraintCapacity);
+            }
+        }
+    }
+}
+
 void ProjectSelfCollision(const Constraint *this, ParticlePool *particles, float deltaTime)
 {
     PASSERTRETURN(this->participantCount == 2, LOG_WARNING, 
         "Incorrect number of participants in self collision constraint. Constraint participants must equal 2.");
 
     const size_t i = this->participants[0], j = this->participants[1];
-    const Vector2 pi = particles->pPositions[i], pj = particles->pPositions[j];
+    const Vector2 pi = GetParticlePosition(particles, i), pj = GetParticlePosition(particles, j);
 
     const Vector2 seperation    = Vector2Subtract(pj, pi);
     const Vector2 gradientC     = Vector2Normalize(seperation);
     const float distance        = Vector2Length(seperation);
     const float restLength      = 2.0f * PARTICLE_RADIUS;
     const float constraintEval  = (distance - restLength);
-    const float iInvMass        = 1.0f / particles->pMasses[i], jInvMass = 1.0f / particles->pMasses[j];
+    const float iInvMass        = 1.0f / PARTICLE_MASS(particles, i), jInvMass = 1.0f / PARTICLE_MASS(particles, j);
     
     const float lambda = constraintEval / (iInvMass + jInvMass);
 
     Vector2 deltaPi = Vector2Scale( gradientC, (lambda * iInvMass));
     Vector2 deltaPj = Vector2Scale( gradientC, (-1.0f * lambda * jInvMass));
 
-    particles->pPositions[i] = Vector2Add(pi, deltaPi);
-    particles->pPositions[j] = Vector2Add(pj, deltaPj);
+    SetParticlePosition(particles, i, Vector2Add(pi, deltaPi));
+    SetParticlePosition(particles, j, Vector2Add(pj, deltaPj));
 }
 
 void ProjectSurfaceCollision(const Constraint *this, ParticlePool *particles, float deltaTime)
@@ -95,12 +196,12 @@ void ProjectSurfaceCollision(const Constraint *this, ParticlePool *particles, fl
         "Incorrect number of participants in self collision constraint. Constraint participants must equal 1.");
 
     const size_t i = this->participants[0];
-    const Vector2 pi = particles->pPositions[i];
-    // const Vector2 vi = ReflectV(particles->pVelocities[i], this->surfaceNormal);
+    const Vector2 pi = GetParticlePosition(particles, i);
+    // const Vector2 vi = ReflectV(GetParticleVelocity(particles, i), this->surfaceNormal);
 
     Vector2 deltaPi = Vector2Scale(this->surfaceNormal, -1.0f * Vector2DotProduct(Vector2Subtract(pi, this->entryPoint), this->surfaceNormal));
     // deltaPi = Vector2Add(deltaPi, Vector2Scale(vi, deltaTime));
-    particles->pPositions[i] = Vector2Add(pi, deltaPi);
+    SetParticlePosition(particles, i, Vector2Add(pi, deltaPi));
 }
 
 void ProjectDistance(const Constraint *this, ParticlePool *particles, float deltaTime)
@@ -111,6 +212,39 @@ void ProjectDistance(const Constraint *this, ParticlePool *particles, float delt
         "Incorrect number of participants in self collision constraint. Constraint participants must equal 2.");
 }
 
+static Constraint SelfCollisionConstraint_(size_t i, size_t j)
+{
+    Constraint c = { 0 };
+    c.type = CONSTRAINT_SELF_COLLISION;
+    c.participants[0] = i;
+    c.participants[1] = j;
+    c.participantCount = 2;
+    c.ProjectFn = ProjectSelfCollision;
+    return c;
+}
+
+static Constraint SurfaceCollisionConstraint_(size_t i, Vector2 sn, Vector2 ep)
+{
+    Constraint c = { 0 };
+    c.type = CONSTRAINT_SURFACE_COLLISION;
+    c.participants[0] = i;
+    c.participantCount = 1;
+    c.ProjectFn = ProjectSurfaceCollision;
+
+    c.surfaceNormal = sn;
+    c.entryPoint = ep;
+    return c;
+}
+
+static Vector2 CalculatePointForce_(Vector2 pi, float mi, const Force *force)
+{
+    Vector2 forceDirection = Vector2Normalize(Vector2Subtract(force->position, pi));
+    const float distanceSqr = Vector2DistanceSqr(force->position, pi);
+    float strength = (mi * force->mass) / distanceSqr;
+    if(force->type == FORCE_REPULSE) { strength *= -1.0; }
+    return Vector2Scale(forceDirection, strength);
+}
+
 static Vector2 CalculateForces_(Vector2 pi, Vector2 vi, float mi, const Force *forces)
 {
     Vector2 externalForces = (Vector2){ 0 };
@@ -128,12 +262,7 @@ static Vector2 CalculateForces_(Vector2 pi, Vector2 vi, float mi, const Force *f
             break;
         case FORCE_ATTRACT:
         case FORCE_REPULSE:
-            Vector2 forceDirection = Vector2Normalize(Vector2Subtract(forces[j].position, pi));
-            const float distanceSqr = Vector2DistanceSqr(forces[j].position, pi);
-            float strength = (mi * forces[j].mass) / distanceSqr;
-            if(forces[j].type == FORCE_REPULSE) { strength *= -1.0; }
-            externalForces = Vector2Add(externalForces, 
-                                Vector2Scale(forceDirection, strength));
+            externalForces = Vector2Add(externalForces, CalculatePointForce_(pi, mi, &forces[j]));
             break;
         default:
             break;
@@ -160,7 +289,7 @@ static Vector2 CalculateEntryPoint_(Vector2 position, Vector2 velocity, Vector2
     return ep;
 }
 
-static size_t GenerateCollisionConstraints_(ParticleSystem *system)
+static size_t GenerateWallConstraints_(ParticleSystem *system)
 {
     size_t collisionCount = 0;
     Vector2 P, v, Q, sn, EP;
@@ -173,8 +302,8 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
     for (size_t i = 0; i < arrlenu(system->spatialHash->queryResults); i++)
     {
         size_t pi = system->spatialHash->queryResults[i];
-        P = system->particles_->pPositions[pi];
-        v = system->particles_->pVelocities[pi];
+        P = GetParticlePosition(system->particles_, pi);
+        v = GetParticleVelocity(system->particles_, pi);
         Q = (Vector2){system->boundaryBox.left + PARTICLE_RADIUS, P.y };
         sn = (Vector2){ 1.0f, 0.0f };
 
@@ -192,8 +321,8 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
     for (size_t i = 0; i < arrlenu(system->spatialHash->queryResults); i++)
     {
         size_t pi = system->spatialHash->queryResults[i];
-        P = system->particles_->pPositions[pi];
-        v = system->particles_->pVelocities[pi];
+        P = GetParticlePosition(system->particles_, pi);
+        v = GetParticleVelocity(system->particles_, pi);
         Q = (Vector2){system->boundaryBox.right - PARTICLE_RADIUS, P.y };
         sn = (Vector2){ -1.0f, 0.0f };
 
@@ -211,8 +340,8 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
     for (size_t i = 0; i < arrlenu(system->spatialHash->queryResults); i++)
     {
         size_t pi = system->spatialHash->queryResults[i];
-        P = system->particles_->pPositions[pi];
-        v = system->particles_->pVelocities[pi];
+        P = GetParticlePosition(system->particles_, pi);
+        v = GetParticleVelocity(system->particles_, pi);
         Q = (Vector2){P.x, system->boundaryBox.top + PARTICLE_RADIUS };
         sn = (Vector2){ 0.0f, 1.0f };
 
@@ -230,8 +359,8 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
     for (size_t i = 0; i < arrlenu(system->spatialHash->queryResults); i++)
     {
         size_t pi = system->spatialHash->queryResults[i];
-        P = system->particles_->pPositions[pi];
-        v = system->particles_->pVelocities[pi];
+        P = GetParticlePosition(system->particles_, pi);
+        v = GetParticleVelocity(system->particles_, pi);
         Q = (Vector2){P.x, system->boundaryBox.bottom - PARTICLE_RADIUS };
         sn = (Vector2){ 0.0f, -1.0f };
 
@@ -242,18 +371,129 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
         collisionCount++;
     }
 
-    // Check for particle self collision
+    return collisionCount;
+}
+
+static inline size_t ClampParticleToWalls_(ParticlePool *particles, size_t i, float xMin, float xMax, float yMin, float yMax)
+{
+    const Vector2 p = GetParticlePosition(particles, i);
+    const Vector2 clamped = { fminf(fmaxf(p.x, xMin), xMax), fminf(fmaxf(p.y, yMin), yMax) };
+    SetParticlePosition(particles, i, clamped);
+    return (size_t)((clamped.x != p.x) | (clamped.y != p.y));
+}
+
+static size_t ClampParticlesToWalls_(ParticleSystem *system, size_t begin, size_t end)
+{
+    // Clamp every particle into the boundary box shrunk by the particle radius.
+    // Particles whose position changed are counted as wall contacts.
+    const float xMin = (float)system->boundaryBox.left + PARTICLE_RADIUS;
+    const float xMax = (float)system->boundaryBox.right - PARTICLE_RADIUS;
+    const float yMin = (float)system->boundaryBox.top + PARTICLE_RADIUS;
+    const float yMax = (float)system->boundaryBox.bottom - PARTICLE_RADIUS;
+
+    ParticlePool *particles = system->particles_;
+    size_t contactCount = 0;
+    size_t i = begin;
+
+#if defined(PARTICLE_SSE2) && (PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA)
+    // Two interleaved particles (x0, y0, x1, y1) per register. The lookup table
+    // maps the 4-bit changed-lane mask to the number of particles that moved.
+    static const uint8_t contactsFromMask[16] = { 0, 1, 1, 1, 1, 2, 2, 2, 1, 2, 2, 2, 1, 2, 2, 2 };
+    Vector2 *positions = particles->pPositions;
+    const __m128 lo = _mm_setr_ps(xMin, yMin, xMin, yMin);
+    const __m128 hi = _mm_setr_ps(xMax, yMax, xMax, yMax);
+    for (; (i + 2) <= end; i += 2)
+    {
+        const __m128 p = _mm_loadu_ps(&positions[i].x);
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(p, lo), hi);
+        _mm_storeu_ps(&positions[i].x, clamped);
+        contactCount += contactsFromMask[_mm_movemask_ps(_mm_cmpneq_ps(p, clamped))];
+    }
+#elif defined(PARTICLE_SSE2)
+    // Four particles per register, x and y in separate registers. Runs start
+    // on a multiple of four so they never straddle an AoSoA block.
+    static const uint8_t contactsFromMask[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    for (; (i < end) && ((i % 4) != 0); i++) { contactCount += ClampParticleToWalls_(particles, i, xMin, xMax, yMin, yMax); }
+
+    const __m128 xLo = _mm_set1_ps(xMin), xHi = _mm_set1_ps(xMax);
+    const __m128 yLo = _mm_set1_ps(yMin), yHi = _mm_set1_ps(yMax);
+    for (; (i + 4) <= end; i += 4)
+    {
+        float *xs = &PARTICLE_X_(particles, i, pPositions), *ys = &PARTICLE_Y_(particles, i, pPositions);
+        const __m128 x = _mm_loadu_ps(xs), y = _mm_loadu_ps(ys);
+        const __m128 xClamped = _mm_min_ps(_mm_max_ps(x, xLo), xHi);
+        const __m128 yClamped = _mm_min_ps(_mm_max_ps(y, yLo), yHi);
+        _mm_storeu_ps(xs, xClamped);
+        _mm_storeu_ps(ys, yClamped);
+        contactCount += contactsFromMask[_mm_movemask_ps(_mm_or_ps(_mm_cmpneq_ps(x, xClamped), _mm_cmpneq_ps(y, yClamped)))];
+    }
+#endif
+
+    for (; i < end; i++) { contactCount += ClampParticleToWalls_(particles, i, xMin, xMax, yMin, yMax); }
+
+    return contactCount;
+}
+
+static size_t GenerateColliderConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch)
+{
+    size_t collisionCount = 0;
+    if (arrlenu(system->colliders->colliders) == 0) { return collisionCount; }
+
+    ColliderContact contacts[MAX_COLLIDER_CONTACTS];
+    for (size_t i = begin; i < end; i++)
+    {
+        const size_t contactCount = QueryColliderContacts(system->colliders,
+            GetParticlePosition(system->particles_, i), PARTICLE_RADIUS, contacts);
+        for (size_t j = 0; j < contactCount; j++)
+        {
+            arrput(scratch->constraints, SurfaceCollisionConstraint_(i, contacts[j].surfaceNormal, contacts[j].entryPoint));
+            collisionCount++;
+        }
+    }
+
+    return collisionCount;
+}
+
+static size_t GenerateFieldConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch)
+{
+    size_t collisionCount = 0;
+    PASSERTRETURNVALUE(system->collisionField, collisionCount, LOG_WARNING, "Collision mode set to field without a collision field.");
+
+    // One field sample per particle. The field gradient is the surface normal
+    // and the entry point lies on the iso-contour at one particle radius.
+    for (size_t i = begin; i < end; i++)
+    {
+        const Vector2 P = GetParticlePosition(system->particles_, i);
+        Vector2 gradient;
+        const float distance = SampleSignedDistanceField(system->collisionField, P, &gradient);
+        if (distance >= PARTICLE_RADIUS) { continue; }
+
+        const float gradientLength = Vector2Length(gradient);
+        if (gradientLength < EPSILON) { continue; }
+
+        const Vector2 sn = Vector2Scale(gradient, 1.0f / gradientLength);
+        const Vector2 EP = Vector2Add(P, Vector2Scale(sn, PARTICLE_RADIUS - distance));
+        arrput(scratch->constraints, SurfaceCollisionConstraint_(i, sn, EP));
+        collisionCount++;
+    }
+
+    return collisionCount;
+}
+
+static size_t GenerateSelfCollisionConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch)
+{
+    size_t collisionCount = 0;
     const float range = 2.0f * PARTICLE_RADIUS;
-    for (size_t i = 0; i < system->particles_->activeCount; i++)
+    for (size_t i = begin; i < end; i++)
     {
-        QueryHashPoint(system->spatialHash, system->particles_->pPositions[i], 2.0f * PARTICLE_RADIUS);
-        for (size_t j = 0; j < arrlenu(system->spatialHash->queryResults); j++)
+        QueryHashPointInto(system->spatialHash, GetParticlePosition(system->particles_, i), 2.0f * PARTICLE_RADIUS, &scratch->queryResults);
+        for (size_t j = 0; j < arrlenu(scratch->queryResults); j++)
         {
-            size_t pj = system->spatialHash->queryResults[j];
+            size_t pj = scratch->queryResults[j];
             if ( i == pj) { continue; }
-            if (Vector2Distance(system->particles_->pPositions[i], system->particles_->pPositions[pj]) < range)
+            if (Vector2Distance(GetParticlePosition(system->particles_, i), GetParticlePosition(system->particles_, pj)) < range)
             {
-                AddSelfCollisionConstraint(system, i, pj);
+                arrput(scratch->constraints, SelfCollisionConstraint_(i, pj));
                 collisionCount++;
             }
         }
@@ -262,107 +502,498 @@ static size_t GenerateCollisionConstraints_(ParticleSystem *system)
     return collisionCount;
 }
 
+static void GenerateCollisionConstraintsRange_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch)
+{
+    switch (system->collisionMode)
+    {
+    case COLLISION_MODE_GEOMETRY:
+        GenerateColliderConstraints_(system, begin, end, scratch);
+        break;
+    case COLLISION_MODE_FIELD:
+        GenerateFieldConstraints_(system, begin, end, scratch);
+        break;
+    default:
+        break;
+    }
+
+    GenerateSelfCollisionConstraints_(system, begin, end, scratch);
+}
+
+static void GenerateCollisionConstraintsJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    ParticleSystem *system = ((ParticleJobContext*)context)->system;
+    if (!system->isDeterministic)
+    {
+        GenerateCollisionConstraintsRange_(system, begin, end, &system->scratch_[workerIndex]);
+        return;
+    }
+
+    // Fixed partitioning. Split the range into JOB_GRAIN_SIZE chunks even when
+    // the serial fallback hands over the whole pool at once.
+    for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += JOB_GRAIN_SIZE)
+    {
+        const size_t chunkEnd = ((chunkBegin + JOB_GRAIN_SIZE) < end) ? (chunkBegin + JOB_GRAIN_SIZE) : end;
+        GenerateCollisionConstraintsRange_(system, chunkBegin, chunkEnd, &system->chunkScratch_[chunkBegin / JOB_GRAIN_SIZE]);
+    }
+}
+
+static size_t GenerateCollisionConstraints_(ParticleSystem *system)
+{
+    size_t collisionCount = 0;
+
+    if (system->collisionMode == COLLISION_MODE_GEOMETRY && system->wallHandler == WALL_HANDLER_HASH_QUERY)
+    {
+        PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_WALL_CONTACTS)
+        {
+            const size_t wallCount = GenerateWallConstraints_(system);
+            system->stats.wallContactCount += wallCount;
+            collisionCount += wallCount;
+        }
+    }
+    if (!system->colliders->isBuilt) { BuildColliderSet(system->colliders); }
+
+    PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_SELF_CONTACTS)
+    {
+        // Contacts are generated into per-worker buffers, then appended in worker order.
+        // In deterministic mode every chunk of JOB_GRAIN_SIZE particles has its own
+        // buffer, so the appended order matches a serial run for any thread count.
+        const size_t activeCount = system->particles_->activeCount;
+        if (system->isDeterministic)
+        {
+            const size_t chunkCount = (activeCount + JOB_GRAIN_SIZE - 1) / JOB_GRAIN_SIZE;
+            const size_t previousCount = arrlenu(system->chunkScratch_);
+            if (chunkCount > previousCount)
+            {
+                MEMORY_SCOPE(MEMORY_TAG_SCRATCH)
+                {
+                    arrsetlen(system->chunkScratch_, chunkCount);
+                }
+                for (size_t c = previousCount; c < chunkCount; c++) { system->chunkScratch_[c] = ConstructParticleScratch_(); }
+            }
+        }
+        ParticleScratch *buffers = system->isDeterministic ? system->chunkScratch_ : system->scratch_;
+        for (size_t w = 0; w < arrlenu(buffers); w++) { arrsetlen(buffers[w].constraints, 0); }
+
+        ParticleJobContext context = { system, 0.0f };
+        ParallelFor(system->jobs, activeCount, JOB_GRAIN_SIZE, GenerateCollisionConstraintsJob_, &context);
+
+        for (size_t w = 0; w < arrlenu(buffers); w++)
+        {
+            const size_t count = arrlenu(buffers[w].constraints);
+            if (count == 0) { continue; }
+
+            memcpy(arraddnptr(system->constraints_, count), buffers[w].constraints, sizeof(Constraint) * count);
+            collisionCount += count;
+        }
+    }
+
+    return collisionCount;
+}
+
+static void AgeParticlesJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    const ParticleJobContext *job = (const ParticleJobContext*)context;
+    ParticlePool *particles = job->system->particles_;
+    const SimdKernels *simd = GetSimdKernels();
+    PARTICLE_RUN_FOR(run, particles, begin, end) { simd->AddScalar(run.lifespans, job->deltaTime, run.count); }
+}
+
 static void UpdateParticlesLife_(ParticleSystem *system, float deltaTime)
 {
     // Update lifespan of particles and deactivate/kill any particles whose
     // lifespan has exceeded its lifetime.
-    size_t deadCount = 0;
-    for (size_t i = 0; i < system->particles_->activeCount; i++) 
-    {
-        system->particles_->pLifespans[i] += deltaTime;
-        if (system->particles_->pLifespans[i] > system->particles_->pLifetimes[i])
-        { 
-            deadCount++;
-            SwapParticles_(system->particles_, i, (system->particles_->activeCount - deadCount));
+    ParticleJobContext context = { system, deltaTime };
+    PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_LIFE)
+    {
+        ParallelFor(system->jobs, system->particles_->activeCount, JOB_GRAIN_SIZE, AgeParticlesJob_, &context);
+
+        // Compaction is inherently serial. Dead particles are replaced by the last
+        // active particle, which is then checked in turn.
+        size_t i = 0;
+        while (i < system->particles_->activeCount)
+        {
+            if (PARTICLE_LIFESPAN(system->particles_, i) > PARTICLE_LIFETIME(system->particles_, i))
+            {
+                KillParticle_(system->particles_, i);
+                continue;
+            }
+            i++;
         }
     }
-    system->particles_->activeCount -= deadCount;
 }
 
-static void UpdateParticleAttributes_(ParticleSystem *system)
+static void IntegrateParticleRun_(const SimdKernels *simd, const ParticleRun *run, const Force *forces,
+    ParticlePool *particles, float deltaTime)
 {
-    for (size_t i = 0; i < system->particles_->activeCount; i++)
+    // Forces are summed per particle in list order, exactly like
+    // CalculateForces_, one stream at a time. Interleaved streams need the
+    // per particle mass and step scale on both lanes.
+    float stepScales[PARTICLE_RUN_SIZE];
+    float forceLanes[2 * PARTICLE_RUN_SIZE];
+    simd->InverseScale(stepScales, run->masses, deltaTime, run->count);
+
+    const float *masses = run->masses, *scales = stepScales;
+#if PARTICLE_RUN_INTERLEAVED
+    float massLanes[2 * PARTICLE_RUN_SIZE], scaleLanes[2 * PARTICLE_RUN_SIZE];
+    simd->Duplicate(massLanes, run->masses, run->count);
+    simd->Duplicate(scaleLanes, stepScales, run->count);
+    masses = massLanes;
+    scales = scaleLanes;
+#endif
+
+    float *streamForces[PARTICLE_RUN_STREAMS];
+    for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++)
     {
-        const float t = (system->particles_->pLifespans[i] / system->particles_->pLifetimes[i]);
+        streamForces[s] = forceLanes + s * run->laneCount;
+        memset(streamForces[s], 0, sizeof(float) * run->laneCount);
+    }
 
-        system->particles_->pColors[i]  = ColorLerp( system->particles_->pBirthColors[i],
-             system->particles_->pDeathColors[i], t);
+    for (size_t j = 0; j < arrlenu(forces); j++)
+    {
+        switch (forces[j].type)
+        {
+        case FORCE_GRAVITY:
+#if PARTICLE_RUN_INTERLEAVED
+            simd->AccumulateProduct(streamForces[0], masses, 0.0f, GRAVITIONAL_CONST, run->laneCount);
+#else
+            simd->AccumulateProduct(streamForces[0], masses, 0.0f, 0.0f, run->laneCount);
+            simd->AccumulateProduct(streamForces[1], masses, GRAVITIONAL_CONST, GRAVITIONAL_CONST, run->laneCount);
+#endif
+            break;
+        case FORCE_VISCOUS:
+        {
+            const float drag = -6.0f * PI * forces[j].viscosity * PARTICLE_RADIUS;
+            for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++)
+            {
+                simd->AccumulateProduct(streamForces[s], run->velocities[s], drag, drag, run->laneCount);
+            }
+            break;
+        }
+        case FORCE_ATTRACT:
+        case FORCE_REPULSE:
+            for (size_t i = 0; i < run->count; i++)
+            {
+                const Vector2 force = CalculatePointForce_(GetParticlePosition(particles, run->first + i),
+                    run->masses[i], &forces[j]);
+#if PARTICLE_RUN_INTERLEAVED
+                streamForces[0][2 * i] += force.x;
+                streamForces[0][2 * i + 1] += force.y;
+#else
+                streamForces[0][i] += force.x;
+                streamForces[1][i] += force.y;
+#endif
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    PASSERT(simd->AreFinite(forceLanes, PARTICLE_RUN_STREAMS * run->laneCount), LOG_ERROR, "externalForces invalid.");
+
+    for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++)
+    {
+        simd->IntegrateEuler(run->velocities[s], run->positions[s], run->prevPositions[s],
+            streamForces[s], scales, deltaTime, run->laneCount);
+    }
+}
+
+static void AddPointForces_(const ForcePlan *plan, const ParticleRun *run, const ParticlePool *particles, float *forceLanes)
+{
+    // Point forces need a square root and a division per particle and force,
+    // so they stay scalar. One loop per force keeps its parameters in
+    // registers and the per particle sums in CalculateForces_ order.
+    for (size_t k = 0; k < plan->pointCount; k++)
+    {
+        const Force force = plan->points[k];
+        for (size_t i = 0; i < run->count; i++)
+        {
+            const Vector2 point = CalculatePointForce_(GetParticlePosition(particles, run->first + i), run->masses[i], &force);
+#if PARTICLE_RUN_INTERLEAVED
+            forceLanes[2 * i] += point.x;
+            forceLanes[2 * i + 1] += point.y;
+#else
+            forceLanes[i] += point.x;
+            forceLanes[run->laneCount + i] += point.y;
+#endif
+        }
+    }
+}
+
+static void IntegratePlannedRun_(const SimdKernels *simd, SimdIntegrateFn integrate, const ForcePlan *plan,
+    const ParticleRun *run, const ParticlePool *particles, float deltaTime)
+{
+    float forceLanes[2 * PARTICLE_RUN_SIZE];
+    SimdIntegrateArgs args[PARTICLE_RUN_STREAMS];
+    for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++)
+    {
+        // Gravity only pulls on y lanes
+#if PARTICLE_RUN_INTERLEAVED
+        const float gravityEven = 0.0f, gravityOdd = GRAVITIONAL_CONST;
+#else
+        const float gravityEven = (s == 0) ? 0.0f : GRAVITIONAL_CONST, gravityOdd = gravityEven;
+#endif
+        args[s] = (SimdIntegrateArgs){
+            run->velocities[s], run->positions[s], run->prevPositions[s],
+            run->masses, forceLanes + s * run->laneCount,
+            run->laneCount, PARTICLE_RUN_INTERLEAVED,
+            gravityEven, gravityOdd, plan->drag, deltaTime };
+    }
+
+    // Point force sets start their lanes from gravity and drag, the integrate
+    // kernel then only reads the lanes
+    if (plan->terms & SIMD_FORCE_LANES)
+    {
+        for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++) { simd->SumGravityDrag(forceLanes + s * run->laneCount, &args[s]); }
+        AddPointForces_(plan, run, particles, forceLanes);
+        PASSERT(simd->AreFinite(forceLanes, PARTICLE_RUN_STREAMS * run->laneCount), LOG_ERROR, "externalForces invalid.");
+    }
+
+    for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++) { integrate(&args[s]); }
+
+    // Fused sets never store their forces. A non-finite force always leaves a
+    // non-finite velocity, so those are checked on the kernel output instead.
+    if (!(plan->terms & SIMD_FORCE_LANES))
+    {
+        bool isFinite = true;
+        for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++) { isFinite &= simd->AreFinite(run->velocities[s], run->laneCount); }
+        PASSERT(isFinite, LOG_ERROR, "externalForces invalid.");
+    }
+}
+
+static void IntegrateParticlesJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    const ParticleJobContext *job = (const ParticleJobContext*)context;
+    ParticlePool *particles = job->system->particles_;
+    const ForcePlan *plan = job->forcePlan;
+    const SimdKernels *simd = GetSimdKernels();
+
+    if (plan->set == FORCE_SET_GENERIC)
+    {
+        PARTICLE_RUN_FOR(run, particles, begin, end)
+        {
+            IntegrateParticleRun_(simd, &run, job->system->forces_, particles, job->deltaTime);
+        }
+        return;
+    }
+
+    const SimdIntegrateFn integrate = simd->IntegrateForces[plan->terms];
+    PARTICLE_RUN_FOR(run, particles, begin, end) { IntegratePlannedRun_(simd, integrate, plan, &run, particles, job->deltaTime); }
+}
+
+static void CalculateHashCellsJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    ParticleSystem *system = ((ParticleJobContext*)context)->system;
+    CalculatePoolHashCells(system->spatialHash, system->particles_, begin, end);
+}
+
+static void ClampParticlesToWallsJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    ParticleSystem *system = ((ParticleJobContext*)context)->system;
+    system->scratch_[workerIndex].wallContactCount += ClampParticlesToWalls_(system, begin, end);
+}
+
+static void UpdateVelocitiesJob_(void *context, size_t begin, size_t end, uint32_t workerIndex)
+{
+    const ParticleJobContext *job = (const ParticleJobContext*)context;
+    ParticlePool *particles = job->system->particles_;
+    const float inverseDeltaTime = 1.0f / job->deltaTime;
+
+    const SimdKernels *simd = GetSimdKernels();
+
+    PARTICLE_RUN_FOR(run, particles, begin, end)
+    {
+        for (size_t s = 0; s < PARTICLE_RUN_STREAMS; s++)
+        {
+            simd->ScaledDifference(run.velocities[s], run.positions[s], run.prevPositions[s],
+                inverseDeltaTime, run.laneCount);
+        }
     }
 }
 
 static void UpdateParticlesMotion_(ParticleSystem *system, float deltaTime)
 {
+    // The integrate variant is picked once here, the jobs only follow the plan
+    const ForcePlan forcePlan = PlanForces(system->forces_, system->isSpecializingForces);
+    system->stats.forceSet = forcePlan.set;
+
+    ParticleJobContext context = { system, deltaTime, &forcePlan };
+    const size_t activeCount = system->particles_->activeCount;
+
     // Initial particle position estimate
-    for (size_t i = 0; i < system->particles_->activeCount; i++)
+    PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_INTEGRATE)
     {
-        const float inverseMass = 1.0f / system->particles_->pMasses[i];
-        const Vector2 externalForces = CalculateForces_(system->particles_->pPositions[i],
-            system->particles_->pVelocities[i],
-            system->particles_->pMasses[i],
-            system->forces_);
-        const Vector2 deltaV = Vector2Scale(externalForces, (deltaTime * inverseMass));
-
-        system->particles_->pVelocities[i]  = Vector2Add(system->particles_->pVelocities[i], deltaV);
-        system->particles_->pPrevPositions[i] = system->particles_->pPositions[i];
-        system->particles_->pPositions[i] = Vector2Add(system->particles_->pPositions[i], 
-            Vector2Scale(system->particles_->pVelocities[i], deltaTime));
+        ParallelFor(system->jobs, activeCount, JOB_GRAIN_SIZE, IntegrateParticlesJob_, &context);
     }
 
-    // Construct Spatial hash map of current particle positions.
-    ClearHash(system->spatialHash);
-    FillHash(system->spatialHash, system->particles_);
+    size_t collisionCount = 0;
+    if (system->domain)
+    {
+        // Contacts are generated and projected per tile. Only the persistent
+        // constraints are left for the global solver below.
+        if (!system->colliders->isBuilt) { BuildColliderSet(system->colliders); }
+        PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_DOMAIN)
+        {
+            system->stats.contactCount += SolveDomain(system->domain, system, deltaTime);
+        }
+    }
+    else
+    {
+        // Construct Spatial hash map of current particle positions.
+        PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_CLEAR_HASH)
+        {
+            ClearHash(system->spatialHash);
+        }
+        PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_FILL_HASH)
+        {
+            ParallelFor(system->jobs, activeCount, JOB_GRAIN_SIZE, CalculateHashCellsJob_, &context);
+            FillHashFromCells(system->spatialHash, activeCount);
+        }
+        if (system->isMeasuringHash)
+        {
+            system->stats.hash = MeasureHash(system->spatialHash, system->particles_, activeCount,
+                2.0f * PARTICLE_RADIUS, &system->scratch_[0].queryResults);
+        }
 
-    // Generate self collision constraints
-    size_t collisionCount = GenerateCollisionConstraints_(system);
+        // Generate self collision constraints
+        collisionCount = GenerateCollisionConstraints_(system);
+        system->stats.contactCount += collisionCount;
+    }
 
     // Project constraints (solver)
-    for (size_t i = 0; i < arrlenu(system->constraints_); i++)
+    PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_PROJECT)
     {
-        const Constraint c = system->constraints_[i];
-        c.ProjectFn(&c, system->particles_, deltaTime);
+        for (size_t i = 0; i < arrlenu(system->constraints_); i++)
+        {
+            const Constraint c = system->constraints_[i];
+            c.ProjectFn(&c, system->particles_, deltaTime);
+        }
     }
 
     // Remove collision constraints
     arrsetlen(system->constraints_, (arrlen(system->constraints_) - collisionCount));
     PASSERT((arrlen(system->constraints_) >= 0), LOG_ERROR, "");
 
+    // Resolve wall contacts after the solver so that no constraint can push a
+    // particle back out of the boundary box. Tiles do not query walls, so the
+    // domain solver always relies on the clamp.
+    if (system->collisionMode == COLLISION_MODE_GEOMETRY &&
+        (system->wallHandler == WALL_HANDLER_CLAMP || system->domain))
+    {
+        PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_WALL_CONTACTS)
+        {
+            for (size_t w = 0; w < arrlenu(system->scratch_); w++) { system->scratch_[w].wallContactCount = 0; }
+
+            ParallelFor(system->jobs, activeCount, JOB_GRAIN_SIZE, ClampParticlesToWallsJob_, &context);
+
+            for (size_t w = 0; w < arrlenu(system->scratch_); w++) { system->stats.wallContactCount += system->scratch_[w].wallContactCount; }
+        }
+    }
+
     // Update velocities after constraint solver
-    for (size_t i = 0; i < system->particles_->activeCount; i++)
+    PROFILE_SCOPE(system->stats.phaseTimes, PROFILE_PHASE_VELOCITY)
     {
-        system->particles_->pVelocities[i] = Vector2Scale(
-            Vector2Subtract(system->particles_->pPositions[i], system->particles_->pPrevPositions[i]), 
-                (1.0f / deltaTime));
+        ParallelFor(system->jobs, activeCount, JOB_GRAIN_SIZE, UpdateVelocitiesJob_, &context);
     }
 }
 
+ForcePlan PlanForces(const Force *forces, bool isSpecializing)
+{
+    const ForcePlan generic = { FORCE_SET_GENERIC, 0, 0.0f, NULL, 0 };
+    const size_t count = arrlenu(forces);
+    if (!isSpecializing) { return generic; }
+    if (count == 0) { return (ForcePlan){ FORCE_SET_NONE, 0, 0.0f, NULL, 0 }; }
+
+    // Terms must come in list order for the sums to match CalculateForces_
+    if (forces[0].type != FORCE_GRAVITY) { return generic; }
+    if (count == 1) { return (ForcePlan){ FORCE_SET_GRAVITY, SIMD_FORCE_GRAVITY, 0.0f, NULL, 0 }; }
+    if (forces[1].type != FORCE_VISCOUS) { return generic; }
+
+    const float drag = -6.0f * PI * forces[1].viscosity * PARTICLE_RADIUS;
+    if (count == 2) { return (ForcePlan){ FORCE_SET_GRAVITY_VISCOUS, SIMD_FORCE_GRAVITY | SIMD_FORCE_DRAG, drag, NULL, 0 }; }
+
+    for (size_t j = 2; j < count; j++)
+    {
+        if (forces[j].type != FORCE_ATTRACT && forces[j].type != FORCE_REPULSE) { return generic; }
+    }
+    return (ForcePlan){ FORCE_SET_GRAVITY_VISCOUS_POINTS, SIMD_FORCE_LANES, drag, forces + 2, count - 2 };
+}
+
 ParticleSystem* ConstructParticleSystem(uint32_t left, uint32_t right, uint32_t top, uint32_t bottom)
 {
-    ParticleSystem* system = (ParticleSystem*)malloc(sizeof(ParticleSystem));
-    PASSERT(system, LOG_FATAL, "Failed to allocate particle pool");
-    if(!system) { return NULL; }
+    // One page block holds the system, the pool and the global spatial hash.
+    // The full pool passes then stream through a single mapping, a couple of
+    // huge pages instead of well over a hundred small ones.
+    const size_t poolOffset = AlignCacheLine_(sizeof(ParticleSystem));
+    const size_t hashOffset = poolOffset + AlignCacheLine_(sizeof(ParticlePool));
+    const size_t stateSize = hashOffset + AlignCacheLine_(sizeof(Hash));
+    const bool isHugePage = PARTICLE_HUGE_PAGES;
+
+    uint8_t *state = (uint8_t*)TrackedAllocatePages(MEMORY_TAG_STATE, stateSize, isHugePage);
+    PASSERT(state, LOG_FATAL, "Failed to allocate particle system state");
+    if(!state) { return NULL; }
+
+    ParticleSystem* system = (ParticleSystem*)state;
+    system->stateSize_ = stateSize;
+    system->isHugePageState_ = isHugePage;
 
     system->boundaryBox.left = left;
     system->boundaryBox.right = right;
     system->boundaryBox.top = top;
     system->boundaryBox.bottom = bottom;
-    system->spatialHash = ConstructHash(2.0f * PARTICLE_RADIUS);
+    system->spatialHash = (Hash*)(state + hashOffset);
+    InitHash(system->spatialHash, 2.0f * PARTICLE_RADIUS);
+    system->colliders = ConstructColliderSet();
+
+    system->collisionMode   = COLLISION_MODE_GEOMETRY;
+    system->wallHandler     = WALL_HANDLER_CLAMP;
+    system->collisionField  = NULL;
 
     system->emitter.position    = (Vector2){ 0 };
     system->emitter.radius      = EMITTER_RADIUS;
     
     system->constraints_    = NULL;
     system->forces_         = NULL;
-    system->particles_ = ConstructParticlePool_();
+    MEMORY_SCOPE(MEMORY_TAG_CONSTRAINTS)
+    {
+        arrsetcap(system->constraints_, 256);
+    }
+    MEMORY_SCOPE(MEMORY_TAG_FORCES)
+    {
+        arrsetcap(system->forces_, 8);
+    }
+    system->particles_ = (ParticlePool*)(state + poolOffset);
+    InitParticlePool_(system->particles_);
+
+    system->stats = (ParticleSystemStats){ 0 };
+
+    system->isDeterministic = false;
+    system->isMeasuringHash = false;
+    system->isSpecializingForces = true;
+    SeedParticleSystem(system, PARTICLE_RANDOM_SEED);
+
+    system->jobs     = NULL;
+    system->scratch_ = NULL;
+    system->chunkScratch_ = NULL;
+    system->frameArena_ = ConstructArena(FRAME_ARENA_CAPACITY);
+    SetJobSystem(system, NULL);
+    system->domain   = NULL;
 
     return system;
 }
 
 void DestructParticleSystem(ParticleSystem *system)
 {
+    FreeParticleScratch_(system->scratch_);
+    FreeParticleScratch_(system->chunkScratch_);
+    DestructArena(system->frameArena_);
+    if (system->domain) { DestructDomain(system->domain); }
     arrfree(system->constraints_);
     arrfree(system->forces_);
-    DestructParticlePool_(system->particles_);
-    free(system);
+    DestroyHash(system->spatialHash);
+    DestructColliderSet(system->colliders);
+    if (system->collisionField) { DestructSignedDistanceField(system->collisionField); }
+    TrackedFreePages(system, MEMORY_TAG_STATE, system->stateSize_, system->isHugePageState_);
 }
 
 void EmitParticle(ParticleSystem *system, const Vector2 position, const ParticleProps *props) 
@@ -375,50 +1006,206 @@ void EmitParticle(ParticleSystem *system, const Vector2 position, const Particle
     PASSERT((props->variance > -EPSILON && props->variance < (1.0 + EPSILON)),
         LOG_WARNING, "variance value outside valid range [0.0, 1.0]. Clamping value to valid range.");
     const float variance = Clamp(props->variance, 0.0f, 1.0f);
-    const float randomScalar = GetRandomValueF();
+    const float randomScalar = NextRandomF(&system->randomState);
 
-    system->particles_->pLifetimes[i]    = props->lifetime + (props->lifetime * (GetRandomValueF() * variance));
-    system->particles_->pLifespans[i]    = 0;
+    PARTICLE_LIFETIME(system->particles_, i) = props->lifetime + (props->lifetime * (NextRandomF(&system->randomState) * variance));
+    PARTICLE_LIFESPAN(system->particles_, i) = 0;
 
-    system->particles_->pPositions[i]    = position;
-    system->particles_->pVelocities[i]   = Vector2Add(props->velocity,
-                                            Vector2Scale(props->velocity, randomScalar * variance));
-    system->particles_->pMasses[i]       = props->mass;
+    SetParticlePosition(system->particles_, i, position);
+    SetParticleStepPosition(system->particles_, i, position);
+    SetParticleVelocity(system->particles_, i, Vector2Add(props->velocity,
+                                            Vector2Scale(props->velocity, randomScalar * variance)));
+    PARTICLE_MASS(system->particles_, i) = props->mass;
 
-    system->particles_->pBirthColors[i]  = props->birthColor;
-    system->particles_->pDeathColors[i]  = props->deathColor;
-    system->particles_->pColors[i]       = system->particles_->pBirthColors[i];
+    PASSERT(props->type < PARTICLE_TYPE_COUNT, LOG_WARNING, "Invalid particle type %d. Using WATER.", (int)props->type);
+    PARTICLE_TYPE(system->particles_, i) = (uint8_t)((props->type < PARTICLE_TYPE_COUNT) ? props->type : WATER);
 }
 
 void UpdateParticles(ParticleSystem *system, float deltaTime)
 {
     PASSERTRETURN((deltaTime > EPSILON), LOG_WARNING, "delta equal to zero. Skipping update step");
 
+    system->stats = (ParticleSystemStats){ 0 };
+    const MemoryStats memoryBefore = GetMemoryStats();
+    ResetFrameScratch_(system);
+
     UpdateParticlesLife_(system, deltaTime);
-    UpdateParticleAttributes_(system);
 
-    const int substeps = 6;
-    const float deltaTimeSubstep = deltaTime / (float)substeps;
-    for(size_t i = 0; i < substeps; i++)
+    // Previous positions only span the last substep. Keep the positions at the
+    // start of the whole step for render interpolation.
+    CopyStepPositions_(system->particles_);
+
+    const float deltaTimeSubstep = deltaTime / (float)PARTICLE_SUBSTEPS;
+    for(size_t i = 0; i < PARTICLE_SUBSTEPS; i++)
+    {
+        TRACE_SCOPE("substep")
+        {
+            UpdateParticlesMotion_(system, deltaTimeSubstep);
+        }
+    }
+
+    const MemoryStats memoryAfter = GetMemoryStats();
+    system->stats.allocationCount = (size_t)(memoryAfter.allocationCount - memoryBefore.allocationCount);
+    system->stats.reallocationCount = (size_t)(memoryAfter.reallocationCount - memoryBefore.reallocationCount);
+    system->stats.arena = GetArenaStats(system->frameArena_);
+}
+
+void SetJobSystem(ParticleSystem *system, JobSystem *jobs)
+{
+    // The job system is not owned by the particle system. Scratch buffers are
+    // kept per worker thread so that contact generation needs no locking.
+    system->jobs = jobs;
+
+    const size_t workerCount = GetJobThreadCount(jobs);
+    for (size_t w = workerCount; w < arrlenu(system->scratch_); w++)
+    {
+        arrfree(system->scratch_[w].queryResults);
+        arrfree(system->scratch_[w].constraints);
+    }
+    const size_t previousCount = arrlenu(system->scratch_);
+    MEMORY_SCOPE(MEMORY_TAG_SCRATCH)
+    {
+        arrsetlen(system->scratch_, workerCount);
+    }
+    for (size_t w = previousCount; w < workerCount; w++) { system->scratch_[w] = ConstructParticleScratch_(); }
+}
+
+void SetDomainDecomposition(ParticleSystem *system, uint32_t tileCount)
+{
+    // A tile count of zero disables the decomposition. Tiles must be at least
+    // one contact range wide so ghosts never reach past the neighbouring tile.
+    if (system->domain)
+    {
+        DestructDomain(system->domain);
+        system->domain = NULL;
+    }
+    if (tileCount == 0) { return; }
+
+    const float range = 2.0f * PARTICLE_RADIUS;
+    const uint32_t maxTileCount = (uint32_t)((system->boundaryBox.right - system->boundaryBox.left) / range);
+    PASSERT(tileCount <= maxTileCount, LOG_WARNING,
+        "Domain tile count %u leaves tiles narrower than the contact range. Clamping to %u.", tileCount, maxTileCount);
+    if (tileCount > maxTileCount) { tileCount = maxTileCount; }
+    if (tileCount == 0) { return; }
+
+    system->domain = ConstructDomain(tileCount, range);
+}
+
+void SetForcePosition(ParticleSystem *system, size_t index, Vector2 position)
+{
+    PASSERTRETURN(index < arrlenu(system->forces_), LOG_WARNING, "Force index %zu out of range", index);
+    system->forces_[index].position = position;
+}
+
+void SetForceType(ParticleSystem *system, size_t index, ForceType type)
+{
+    PASSERTRETURN(index < arrlenu(system->forces_), LOG_WARNING, "Force index %zu out of range", index);
+    system->forces_[index].type = type;
+}
+
+void SeedParticleSystem(ParticleSystem *system, uint64_t seed)
+{
+    // Spread the seed with a splitmix64 step, xorshift state must not be zero
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    system->randomState = z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+static uint64_t HashBytes_(uint64_t hash, const void *data, size_t size)
+{
+    // FNV-1a
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
     {
-        UpdateParticlesMotion_(system, deltaTimeSubstep);
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
     }
+    return hash;
 }
 
-void DrawParticles(const ParticleSystem *system)
+uint64_t HashParticleState(const ParticleSystem *system)
 {
-    for (size_t i = 0; i < system->particles_->activeCount; i++)
+    // Hash of the active pool state and the random stream. Two runs are
+    // bit-identical only if every simulated attribute matches.
+    const ParticlePool *particles = system->particles_;
+    const size_t n = particles->activeCount;
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = HashBytes_(hash, &n, sizeof(n));
+    hash = HashBytes_(hash, &system->randomState, sizeof(system->randomState));
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+    hash = HashBytes_(hash, particles->pLifetimes, sizeof(float) * n);
+    hash = HashBytes_(hash, particles->pLifespans, sizeof(float) * n);
+    hash = HashBytes_(hash, particles->pPrevPositions, sizeof(Vector2) * n);
+    hash = HashBytes_(hash, particles->pPositions, sizeof(Vector2) * n);
+    hash = HashBytes_(hash, particles->pVelocities, sizeof(Vector2) * n);
+    hash = HashBytes_(hash, particles->pMasses, sizeof(float) * n);
+    hash = HashBytes_(hash, particles->pTypes, sizeof(uint8_t) * n);
+#else
+    // Same byte stream as the SoA layout, so checksums compare across layouts
+    for (size_t i = 0; i < n; i++) { hash = HashBytes_(hash, &PARTICLE_LIFETIME(particles, i), sizeof(float)); }
+    for (size_t i = 0; i < n; i++) { hash = HashBytes_(hash, &PARTICLE_LIFESPAN(particles, i), sizeof(float)); }
+    for (size_t i = 0; i < n; i++)
     {
-        DrawCircleV(system->particles_->pPositions[i], 
-            PARTICLE_RADIUS, system->particles_->pColors[i]);
+        const Vector2 prevPosition = GetParticlePrevPosition(particles, i);
+        hash = HashBytes_(hash, &prevPosition, sizeof(Vector2));
     }
+    for (size_t i = 0; i < n; i++)
+    {
+        const Vector2 position = GetParticlePosition(particles, i);
+        hash = HashBytes_(hash, &position, sizeof(Vector2));
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        const Vector2 velocity = GetParticleVelocity(particles, i);
+        hash = HashBytes_(hash, &velocity, sizeof(Vector2));
+    }
+    for (size_t i = 0; i < n; i++) { hash = HashBytes_(hash, &PARTICLE_MASS(particles, i), sizeof(float)); }
+    for (size_t i = 0; i < n; i++) { hash = HashBytes_(hash, &PARTICLE_TYPE(particles, i), sizeof(uint8_t)); }
+#endif
+    return hash;
 }
 
-void DrawForces(const ParticleSystem *system)
+void SetCollisionField(ParticleSystem *system, SignedDistanceField *field)
 {
-    for (size_t i = 0; i < arrlenu(system->forces_); i++)
+    // The system takes ownership of the field
+    if (system->collisionField && system->collisionField != field)
     {
-        switch (system->forces_[i].type)
+        DestructSignedDistanceField(system->collisionField);
+    }
+    system->collisionField = field;
+    system->collisionMode = field ? COLLISION_MODE_FIELD : COLLISION_MODE_GEOMETRY;
+}
+
+void BakeCollisionField(ParticleSystem *system, float cellSize)
+{
+    // Bake the boundary walls and the static colliders into a single field. The
+    // grid extends one particle radius past the boundary so that particles
+    // pushed outside still sample a valid gradient.
+    const Rectangle container = {
+        system->boundaryBox.left, system->boundaryBox.top,
+        (float)(system->boundaryBox.right - system->boundaryBox.left),
+        (float)(system->boundaryBox.bottom - system->boundaryBox.top) };
+    const Vector2 origin = { container.x - PARTICLE_RADIUS, container.y - PARTICLE_RADIUS };
+    const int width  = (int)ceilf((container.width + (2.0f * PARTICLE_RADIUS)) / cellSize) + 1;
+    const int height = (int)ceilf((container.height + (2.0f * PARTICLE_RADIUS)) / cellSize) + 1;
+
+    SignedDistanceField *field = ConstructSignedDistanceField(origin, cellSize, width, height);
+    PASSERTRETURN(field, LOG_ERROR, "Failed to bake collision field.");
+
+    BakeSignedDistanceFieldFromColliders(field, system->colliders, container);
+    SetCollisionField(system, field);
+}
+
+// Drawing needs the raylib renderer, headless builds only link the simulation
+#if !defined(PARTICLE_HEADLESS)
+void DrawForces(const Force *forces, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (forces[i].type)
         {
         case FORCE_GRAVITY:
         DrawCircleV((Vector2){0.0f, 0.0f}, 8.0f, GREEN);
@@ -428,38 +1215,23 @@ void DrawForces(const ParticleSystem *system)
             break;
         case FORCE_ATTRACT:
         case FORCE_REPULSE:
-        DrawCircleV(system->forces_[i].position, 8.0f, YELLOW);
+        DrawCircleV(forces[i].position, 8.0f, YELLOW);
             break;
         default:
             break;
         }
     }
 }
+#endif
 
 void AddSelfCollisionConstraint(ParticleSystem *system, size_t i, size_t j)
 {
-    Constraint c = { 0 };
-    c.type = CONSTRAINT_SELF_COLLISION;
-    c.participants[0] = i;
-    c.participants[1] = j;
-    c.participantCount = 2;
-    c.ProjectFn = ProjectSelfCollision;
-
-    arrput(system->constraints_, c);
+    arrput(system->constraints_, SelfCollisionConstraint_(i, j));
 }
 
 void AddSurfaceCollisionConstraint(ParticleSystem *system, size_t i, Vector2 sn, Vector2 ep)
 {
-    Constraint c = { 0 };
-    c.type = CONSTRAINT_SURFACE_COLLISION;
-    c.participants[0] = i;
-    c.participantCount = 1;
-    c.ProjectFn = ProjectSurfaceCollision;
-
-    c.surfaceNormal = sn;
-    c.entryPoint = ep;
-    
-    arrput(system->constraints_, c);
+    arrput(system->constraints_, SurfaceCollisionConstraint_(i, sn, ep));
 }
 
 void AddDistanceConstraint(ParticleSystem *system, size_t i, size_t j)
@@ -1,6 +1,10 @@
 #pragma once
 #include "raylib.h"
 #include "config.h"
+#include "profiler.h"
+#include "hash.h"
+#include "allocator.h"
+#include "simd.h"
 
 #define PARTICLE_RADIUS 4.0f
 #define EMITTER_RADIUS 24.0f
@@ -8,14 +12,26 @@
 
 // Forward declaration
 typedef struct Hash Hash;
+typedef struct ColliderSet ColliderSet;
+typedef struct SignedDistanceField SignedDistanceField;
+typedef struct JobSystem JobSystem;
+typedef struct Domain Domain;
 
 // Particles
 // -----------------
 typedef enum { 
     WATER, 
     SAND,
+    PARTICLE_TYPE_COUNT,
 } ParticleType;
 
+// Colors over a particle's life are shared by all particles of a type. The
+// renderer interpolates them by normalized age, the pool only stores the type.
+typedef struct ParticlePalette
+{
+    Color birthColor, deathColor;
+}ParticlePalette;
+
 typedef struct ParticleProps
 {
     float variance;
@@ -24,32 +40,212 @@ typedef struct ParticleProps
     Vector2 velocity;
     float mass;
 
-    Color birthColor, deathColor;
+    ParticleType type;
 }ParticleProps;
 
+// Particle pool
+// -----------------
+// The layout is chosen at compile time with PARTICLE_LAYOUT. Code outside the
+// layout specific kernels reads and writes attributes only through the
+// accessors below, so every layout runs the same solver.
+//
+// Arrays come first and each spans a whole number of cache lines, so in the
+// cache line aligned state block every array starts on a cache line.
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+
 typedef struct ParticlePool
 {
-    size_t activeCount;
-
     float pLifetimes[MAX_PARTICLE_COUNT];
     float pLifespans[MAX_PARTICLE_COUNT];
 
     Vector2 pPrevPositions[MAX_PARTICLE_COUNT];
+    Vector2 pStepPositions[MAX_PARTICLE_COUNT]; // position at the start of the last UpdateParticles call
     Vector2 pPositions[MAX_PARTICLE_COUNT];     // aPositions
     Vector2 pVelocities[MAX_PARTICLE_COUNT];    // aVelocity
     float pMasses[MAX_PARTICLE_COUNT];    // aMass
 
-    Color pBirthColors[MAX_PARTICLE_COUNT];
-    Color pDeathColors[MAX_PARTICLE_COUNT];
-    Color pColors[MAX_PARTICLE_COUNT];   // aColor
+    uint8_t pTypes[MAX_PARTICLE_COUNT];   // ParticleType
+
+    size_t activeCount;
+}ParticlePool;
+
+#define PARTICLE_FIELD_(particles, i, field) ((particles)->field[i])
+#define PARTICLE_X_(particles, i, field) ((particles)->field[i].x)
+#define PARTICLE_Y_(particles, i, field) ((particles)->field[i].y)
+
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_SPLIT
+
+typedef struct ParticlePool
+{
+    float pLifetimes[MAX_PARTICLE_COUNT];
+    float pLifespans[MAX_PARTICLE_COUNT];
+
+    float pPrevPositionsX[MAX_PARTICLE_COUNT], pPrevPositionsY[MAX_PARTICLE_COUNT];
+    float pStepPositionsX[MAX_PARTICLE_COUNT], pStepPositionsY[MAX_PARTICLE_COUNT];
+    float pPositionsX[MAX_PARTICLE_COUNT], pPositionsY[MAX_PARTICLE_COUNT];
+    float pVelocitiesX[MAX_PARTICLE_COUNT], pVelocitiesY[MAX_PARTICLE_COUNT];
+    float pMasses[MAX_PARTICLE_COUNT];
+
+    uint8_t pTypes[MAX_PARTICLE_COUNT];
+
+    size_t activeCount;
+}ParticlePool;
+
+#define PARTICLE_FIELD_(particles, i, field) ((particles)->field[i])
+#define PARTICLE_X_(particles, i, field) ((particles)->field##X[i])
+#define PARTICLE_Y_(particles, i, field) ((particles)->field##Y[i])
+
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_AOSOA
+
+// Everything the solver touches for a particle lies within one block, while
+// a block still offers contiguous runs of each component. Blocks are padded
+// to whole cache lines, so no block straddles a line boundary.
+#define PARTICLE_BLOCK_BYTES_ (((11 * sizeof(float)) + sizeof(uint8_t)) * PARTICLE_BLOCK_SIZE)
+
+typedef union ParticleBlock
+{
+    struct
+    {
+        float pLifetimes[PARTICLE_BLOCK_SIZE];
+        float pLifespans[PARTICLE_BLOCK_SIZE];
+
+        float pPrevPositionsX[PARTICLE_BLOCK_SIZE], pPrevPositionsY[PARTICLE_BLOCK_SIZE];
+        float pStepPositionsX[PARTICLE_BLOCK_SIZE], pStepPositionsY[PARTICLE_BLOCK_SIZE];
+        float pPositionsX[PARTICLE_BLOCK_SIZE], pPositionsY[PARTICLE_BLOCK_SIZE];
+        float pVelocitiesX[PARTICLE_BLOCK_SIZE], pVelocitiesY[PARTICLE_BLOCK_SIZE];
+        float pMasses[PARTICLE_BLOCK_SIZE];
+
+        uint8_t pTypes[PARTICLE_BLOCK_SIZE];
+    };
+    uint8_t pLines_[CACHE_LINE_SIZE * ((PARTICLE_BLOCK_BYTES_ + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE)];
+}ParticleBlock;
+
+typedef struct ParticlePool
+{
+    ParticleBlock pBlocks[MAX_PARTICLE_COUNT / PARTICLE_BLOCK_SIZE];
+
+    size_t activeCount;
 }ParticlePool;
 
+#define PARTICLE_FIELD_(particles, i, field) \
+    ((particles)->pBlocks[(i) / PARTICLE_BLOCK_SIZE].field[(i) % PARTICLE_BLOCK_SIZE])
+#define PARTICLE_X_(particles, i, field) PARTICLE_FIELD_(particles, i, field##X)
+#define PARTICLE_Y_(particles, i, field) PARTICLE_FIELD_(particles, i, field##Y)
+
+_Static_assert((MAX_PARTICLE_COUNT % PARTICLE_BLOCK_SIZE) == 0, "MAX_PARTICLE_COUNT must be a multiple of PARTICLE_BLOCK_SIZE");
+_Static_assert((sizeof(ParticleBlock) % CACHE_LINE_SIZE) == 0, "ParticleBlock must span whole cache lines, update PARTICLE_BLOCK_BYTES_");
+
+#else
+    #error "Unknown PARTICLE_LAYOUT"
+#endif
+
+_Static_assert((MAX_PARTICLE_COUNT % CACHE_LINE_SIZE) == 0, "MAX_PARTICLE_COUNT must be a multiple of CACHE_LINE_SIZE");
+
+// Scalar attributes as lvalues
+#define PARTICLE_LIFETIME(particles, i) PARTICLE_FIELD_(particles, i, pLifetimes)
+#define PARTICLE_LIFESPAN(particles, i) PARTICLE_FIELD_(particles, i, pLifespans)
+#define PARTICLE_MASS(particles, i) PARTICLE_FIELD_(particles, i, pMasses)
+#define PARTICLE_TYPE(particles, i) PARTICLE_FIELD_(particles, i, pTypes)     // ParticleType as uint8_t
+
+// Vector attributes, GetParticlePosition/SetParticlePosition and so on
+#define PARTICLE_VECTOR_ACCESSORS_(name, field) \
+    static inline Vector2 GetParticle##name(const ParticlePool *particles, size_t i) \
+    { \
+        return (Vector2){ PARTICLE_X_(particles, i, field), PARTICLE_Y_(particles, i, field) }; \
+    } \
+    static inline void SetParticle##name(ParticlePool *particles, size_t i, Vector2 value) \
+    { \
+        PARTICLE_X_(particles, i, field) = value.x; \
+        PARTICLE_Y_(particles, i, field) = value.y; \
+    }
+
+PARTICLE_VECTOR_ACCESSORS_(Position, pPositions)
+PARTICLE_VECTOR_ACCESSORS_(PrevPosition, pPrevPositions)
+PARTICLE_VECTOR_ACCESSORS_(StepPosition, pStepPositions)    // position at the start of the last UpdateParticles call
+PARTICLE_VECTOR_ACCESSORS_(Velocity, pVelocities)
+
+// Particle runs
+// -----------------
+// The streaming passes hand whole runs of attributes to the SIMD kernels in
+// simd.h. A run holds at most PARTICLE_RUN_SIZE consecutive particles whose
+// attributes are contiguous, it never crosses an AoSoA block. Vector
+// attributes are one interleaved stream of 2 * count floats in the SoA layout
+// (PARTICLE_RUN_INTERLEAVED) and an x and a y stream of count floats otherwise.
+#define PARTICLE_RUN_SIZE 256
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+    #define PARTICLE_RUN_INTERLEAVED 1
+    #define PARTICLE_RUN_STREAMS 1
+#else
+    #define PARTICLE_RUN_INTERLEAVED 0
+    #define PARTICLE_RUN_STREAMS 2
+#endif
+
+typedef struct ParticleRun
+{
+    size_t first, count;
+    size_t laneCount;       // floats per vector stream
+
+    float *positions[PARTICLE_RUN_STREAMS];
+    float *prevPositions[PARTICLE_RUN_STREAMS];
+    float *velocities[PARTICLE_RUN_STREAMS];
+    float *masses;
+    float *lifetimes;
+    float *lifespans;
+}ParticleRun;
+
+// Run starting at first and ending no later than end, empty when first is
+// past the end. Takes a const pool so read-only passes can use it, writing
+// through the run needs a mutable pool.
+static inline ParticleRun GetParticleRun(const ParticlePool *particles, size_t first, size_t end)
+{
+    ParticleRun run = { first, 0 };
+    if (first >= end) { return run; }
+
+    run.count = end - first;
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_AOSOA
+    ParticleBlock *block = (ParticleBlock*)&particles->pBlocks[first / PARTICLE_BLOCK_SIZE];
+    const size_t lane = first % PARTICLE_BLOCK_SIZE;
+    if (run.count > PARTICLE_BLOCK_SIZE - lane) { run.count = PARTICLE_BLOCK_SIZE - lane; }
+    #define PARTICLE_RUN_FIELD_(field) (&block->field[lane])
+#else
+    ParticlePool *pool = (ParticlePool*)particles;
+    if (run.count > PARTICLE_RUN_SIZE) { run.count = PARTICLE_RUN_SIZE; }
+    #define PARTICLE_RUN_FIELD_(field) (&pool->field[first])
+#endif
+
+#if PARTICLE_RUN_INTERLEAVED
+    run.laneCount = 2 * run.count;
+    run.positions[0] = &PARTICLE_RUN_FIELD_(pPositions)->x;
+    run.prevPositions[0] = &PARTICLE_RUN_FIELD_(pPrevPositions)->x;
+    run.velocities[0] = &PARTICLE_RUN_FIELD_(pVelocities)->x;
+#else
+    run.laneCount = run.count;
+    run.positions[0] = PARTICLE_RUN_FIELD_(pPositionsX);
+    run.positions[1] = PARTICLE_RUN_FIELD_(pPositionsY);
+    run.prevPositions[0] = PARTICLE_RUN_FIELD_(pPrevPositionsX);
+    run.prevPositions[1] = PARTICLE_RUN_FIELD_(pPrevPositionsY);
+    run.velocities[0] = PARTICLE_RUN_FIELD_(pVelocitiesX);
+    run.velocities[1] = PARTICLE_RUN_FIELD_(pVelocitiesY);
+#endif
+    run.masses = PARTICLE_RUN_FIELD_(pMasses);
+    run.lifetimes = PARTICLE_RUN_FIELD_(pLifetimes);
+    run.lifespans = PARTICLE_RUN_FIELD_(pLifespans);
+    #undef PARTICLE_RUN_FIELD_
+    return run;
+}
+
+// PARTICLE_RUN_FOR(run, particles, begin, end) { ... } visits [begin, end) run by run
+#define PARTICLE_RUN_FOR(run, particles, begin, end) \
+    for (ParticleRun run = GetParticleRun((particles), (begin), (end)); run.first < (end); \
+        run = GetParticleRun((particles), run.first + run.count, (end)))
+
 // Private methods
-static ParticlePool* ConstructParticlePool_();
-static void DestructParticlePool_(ParticlePool *particles);
+static size_t AlignCacheLine_(size_t size);
+static void InitParticlePool_(ParticlePool *particles);
 
 static void SwapParticles_(ParticlePool *particles, size_t i, size_t j);
 static void KillParticle_(ParticlePool *particles, size_t index);
+static void CopyStepPositions_(ParticlePool *particles);
 
 // Forces
 // ---------
@@ -73,6 +269,28 @@ typedef struct Force
     float mass;
 }Force;
 
+// Force lists the integrate pass has a fused kernel for. Every other list,
+// including these forces in another order, is interpreted per run.
+typedef enum ForceSet
+{
+    FORCE_SET_NONE,
+    FORCE_SET_GRAVITY,
+    FORCE_SET_GRAVITY_VISCOUS,
+    FORCE_SET_GRAVITY_VISCOUS_POINTS,   // followed by any number of FORCE_ATTRACT and FORCE_REPULSE
+    FORCE_SET_GENERIC,
+    FORCE_SET_COUNT,
+}ForceSet;
+
+// Force list resolved once per substep into the integrate variant that runs it
+typedef struct ForcePlan
+{
+    ForceSet set;
+    unsigned terms;         // SimdForceTerm mask of the fused integrate kernel
+    float drag;             // coefficient of the FORCE_VISCOUS entry
+    const Force *points;    // FORCE_ATTRACT and FORCE_REPULSE entries, summed per particle ahead of the kernel
+    size_t pointCount;
+}ForcePlan;
+
 // Constraints
 // -----------
 typedef struct Constraint Constraint;
@@ -121,32 +339,126 @@ typedef struct ParticleEmitter
     // size_t startIndex, size;
 }ParticleEmitter;
 
+typedef enum CollisionMode
+{
+    COLLISION_MODE_GEOMETRY,    // boundary walls and colliders
+    COLLISION_MODE_FIELD,       // baked signed distance field
+}CollisionMode;
+
+typedef enum WallHandler
+{
+    WALL_HANDLER_CLAMP,         // branch-free clamp of positions after the solver
+    WALL_HANDLER_HASH_QUERY,    // surface constraints from spatial hash strip queries
+}WallHandler;
+
+typedef struct ParticleSystemStats
+{
+    size_t contactCount;        // collision contacts generated during the last update, summed over substeps
+    size_t wallContactCount;    // particle-wall contacts during the last update
+    size_t allocationCount;     // heap blocks allocated during the last update, process wide
+    size_t reallocationCount;   // heap blocks resized during the last update, process wide
+    ArenaStats arena;           // frame arena after the last update
+    HashStats hash;             // spatial hash health of the last substep, only while measured
+    ForceSet forceSet;          // integrate variant of the last substep
+#if defined(PARTICLE_PROFILE)
+    double phaseTimes[PROFILE_PHASE_COUNT];     // seconds per phase during the last update
+#endif
+}ParticleSystemStats;
+
+// Per worker thread buffers used by the parallel passes. The arrays live in
+// the system's frame arena and are reserved again every update at the
+// capacity they reached in the previous one.
+typedef struct ParticleScratch
+{
+    size_t *queryResults;
+    Constraint *constraints;
+    size_t wallContactCount;
+
+    size_t queryCapacity, constraintCapacity;
+}ParticleScratch;
+
 typedef struct ParticleSystem 
 {
     struct {
         uint32_t left, right, top, bottom;
     } boundaryBox;
     Hash *spatialHash;
+    ColliderSet *colliders;
+
+    CollisionMode collisionMode;
+    WallHandler wallHandler;
+    SignedDistanceField *collisionField;
 
     ParticleEmitter emitter;
 
     Constraint *constraints_;
     Force *forces_;
     ParticlePool *particles_;
+
+    ParticleSystemStats stats;
+
+    // Deterministic mode gives bit-identical pool state for a given seed and
+    // input stream regardless of the thread count. Contacts are buffered per
+    // fixed size chunk instead of per worker and appended in chunk order, so
+    // work stealing cannot reorder the solver.
+    bool isDeterministic;
+    uint64_t randomState;
+
+    bool isMeasuringHash;   // fill stats.hash after every hash fill, costs about one extra contact pass
+    bool isSpecializingForces;  // integrate known force lists with fused kernels, false interprets every list
+
+    JobSystem *jobs;
+    ParticleScratch *scratch_;
+    ParticleScratch *chunkScratch_;
+    Arena *frameArena_;     // transient contact and query buffers, reset at the start of every update
+    Domain *domain;     // spatial domain decomposition, NULL solves the whole pool at once
+
+    // The system, its pool and its spatial hash share one page block, each
+    // part starting on a cache line. See ConstructParticleSystem.
+    size_t stateSize_;
+    bool isHugePageState_;
 }ParticleSystem;
 
+typedef struct ParticleJobContext
+{
+    ParticleSystem *system;
+    float deltaTime;
+    const ForcePlan *forcePlan;     // integrate pass only
+}ParticleJobContext;
+
 // declare extern variables
 // -----------------
 extern ParticleProps defaultParticleProps;
+extern ParticlePalette particlePalettes[PARTICLE_TYPE_COUNT];
+extern const char *particleLayoutName;     // PARTICLE_LAYOUT this build uses
+extern const char *forceSetNames[FORCE_SET_COUNT];
 
 // Private methods
 // -----------------
+static ParticleScratch ConstructParticleScratch_();
+static void FreeParticleScratch_(ParticleScratch *scratch);
+static void ResetFrameScratch_(ParticleSystem *system);
+static uint64_t HashBytes_(uint64_t hash, const void *data, size_t size);
+static Constraint SelfCollisionConstraint_(size_t i, size_t j);
+static Constraint SurfaceCollisionConstraint_(size_t i, Vector2 sn, Vector2 ep);
+static Vector2 CalculatePointForce_(Vector2 pi, float mi, const Force *force);     // FORCE_ATTRACT and FORCE_REPULSE
 static Vector2 CalculateForces_(Vector2 pi, Vector2 vi, float mi, const Force *forces);
 static Vector2 CalculateEntryPoint_(Vector2 position, Vector2 velocity, Vector2 surfacePoint, Vector2 surfaceNormal);
-
+static void IntegrateParticleRun_(const SimdKernels *simd, const ParticleRun *run, const Force *forces,
+    ParticlePool *particles, float deltaTime);
+static void AddPointForces_(const ForcePlan *plan, const ParticleRun *run, const ParticlePool *particles, float *forceLanes);
+static void IntegratePlannedRun_(const SimdKernels *simd, SimdIntegrateFn integrate, const ForcePlan *plan,
+    const ParticleRun *run, const ParticlePool *particles, float deltaTime);
+
+static size_t GenerateWallConstraints_(ParticleSystem *system);
+static inline size_t ClampParticleToWalls_(ParticlePool *particles, size_t i, float xMin, float xMax, float yMin, float yMax);
+static size_t ClampParticlesToWalls_(ParticleSystem *system, size_t begin, size_t end);
+static size_t GenerateColliderConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch);
+static size_t GenerateFieldConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch);
+static size_t GenerateSelfCollisionConstraints_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch);
+static void GenerateCollisionConstraintsRange_(ParticleSystem *system, size_t begin, size_t end, ParticleScratch *scratch);
 static size_t GenerateCollisionConstraints_(ParticleSystem *system);
 static void UpdateParticlesLife_(ParticleSystem *system, float deltaTime);
-static void UpdateParticleAttributes_(ParticleSystem *system);
 static void UpdateParticlesMotion_(ParticleSystem *system, float deltaTime);
 
 // Interface methods
@@ -159,9 +471,24 @@ void UpdateParticles(ParticleSystem *system, float deltaTime);
 
 static inline void AddForce(ParticleSystem *system, Force force){ arrput(system->forces_, force); }
 static inline void RemoveForce(ParticlePool *system){ }
-
-void DrawParticles(const ParticleSystem *system);
-void DrawForces(const ParticleSystem *system);
+static inline size_t GetForceCount(const ParticleSystem *system) { return arrlenu(system->forces_); }
+void SetForcePosition(ParticleSystem *system, size_t index, Vector2 position);
+void SetForceType(ParticleSystem *system, size_t index, ForceType type);
+
+void SetJobSystem(ParticleSystem *system, JobSystem *jobs);
+void SeedParticleSystem(ParticleSystem *system, uint64_t seed);
+static inline void SetDeterministic(ParticleSystem *system, bool isDeterministic) { system->isDeterministic = isDeterministic; }
+uint64_t HashParticleState(const ParticleSystem *system);
+static inline void SetHashDiagnostics(ParticleSystem *system, bool isMeasuring) { system->isMeasuringHash = isMeasuring; }
+static inline void SetForceSpecialization(ParticleSystem *system, bool isSpecializing) { system->isSpecializingForces = isSpecializing; }
+ForcePlan PlanForces(const Force *forces, bool isSpecializing);
+void SetDomainDecomposition(ParticleSystem *system, uint32_t tileCount);
+void SetCollisionField(ParticleSystem *system, SignedDistanceField *field);
+void BakeCollisionField(ParticleSystem *system, float cellSize);
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawForces(const Force *forces, size_t count);
+#endif
 
 void AddSelfCollisionConstraint(ParticleSystem *system, size_t i, size_t j);
 void AddSurfaceCollisionConstraint(ParticleSystem *system, size_t i, Vector2 sn, Vector2 ep);
@@ -2,6 +2,12 @@
 #include <stdint.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
+#include "allocator.h"
+
+// stb_ds arrays are accounted like every other simulation allocation
+#define STBDS_REALLOC(context, ptr, size) TrackedRealloc((ptr), (size))
+#define STBDS_FREE(context, ptr) TrackedFree(ptr)
 #include "stb_ds.h"
 
 #include "raylib.h"
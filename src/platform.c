@@ -0,0 +1,217 @@
+// Deliberately not using pch.h, windows.h and raylib.h cannot share a translation unit.
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOGDI
+    #define NOUSER
+    #include <windows.h>
+#else
+    #define _POSIX_C_SOURCE 200809L
+    #define _DEFAULT_SOURCE     // MAP_ANONYMOUS and madvise
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+typedef struct ThreadStart
+{
+    ThreadFn fn;
+    void *argument;
+}ThreadStart;
+
+#if defined(_WIN32)
+
+static DWORD WINAPI ThreadEntry_(LPVOID parameter)
+{
+    ThreadStart start = *(ThreadStart*)parameter;
+    free(parameter);
+    start.fn(start.argument);
+    return 0;
+}
+
+bool StartThread(Thread *thread, ThreadFn fn, void *argument)
+{
+    ThreadStart *start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) { return false; }
+    start->fn = fn;
+    start->argument = argument;
+
+    thread->handle = CreateThread(NULL, 0, ThreadEntry_, start, 0, NULL);
+    if (!thread->handle) { free(start); return false; }
+    return true;
+}
+
+void JoinThread(Thread *thread)
+{
+    WaitForSingleObject((HANDLE)thread->handle, INFINITE);
+    CloseHandle((HANDLE)thread->handle);
+    thread->handle = NULL;
+}
+
+uint32_t GetHardwareThreadCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (uint32_t)info.dwNumberOfProcessors : 1;
+}
+
+void InitMutex(Mutex *mutex) { InitializeSRWLock((PSRWLOCK)&mutex->lock); }
+void DestroyMutex(Mutex *mutex) { (void)mutex; }
+void LockMutex(Mutex *mutex) { AcquireSRWLockExclusive((PSRWLOCK)&mutex->lock); }
+void UnlockMutex(Mutex *mutex) { ReleaseSRWLockExclusive((PSRWLOCK)&mutex->lock); }
+
+void InitCondition(Condition *condition) { InitializeConditionVariable((PCONDITION_VARIABLE)&condition->variable); }
+void DestroyCondition(Condition *condition) { (void)condition; }
+void WaitCondition(Condition *condition, Mutex *mutex)
+{
+    SleepConditionVariableSRW((PCONDITION_VARIABLE)&condition->variable, (PSRWLOCK)&mutex->lock, INFINITE, 0);
+}
+void SignalCondition(Condition *condition) { WakeConditionVariable((PCONDITION_VARIABLE)&condition->variable); }
+void BroadcastCondition(Condition *condition) { WakeAllConditionVariable((PCONDITION_VARIABLE)&condition->variable); }
+
+size_t GetPageAllocationSize(size_t size, bool isHugePage)
+{
+    // Large pages need the lock pages privilege, normal pages are used instead
+    (void)isHugePage;
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const size_t granularity = (size_t)info.dwPageSize;
+    return (size + granularity - 1) & ~(granularity - 1);
+}
+
+void* AllocatePages(size_t size, bool isHugePage)
+{
+    return VirtualAlloc(NULL, GetPageAllocationSize(size, isHugePage), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void FreePages(void *pages, size_t size, bool isHugePage)
+{
+    (void)size; (void)isHugePage;
+    if (pages) { VirtualFree(pages, 0, MEM_RELEASE); }
+}
+
+double GetPlatformTime()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0) { QueryPerformanceFrequency(&frequency); }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+void SleepPlatform(double seconds)
+{
+    if (seconds > 0.0) { Sleep((DWORD)(seconds * 1000.0)); }
+}
+
+#else
+
+static void* ThreadEntry_(void *parameter)
+{
+    ThreadStart start = *(ThreadStart*)parameter;
+    free(parameter);
+    start.fn(start.argument);
+    return NULL;
+}
+
+bool StartThread(Thread *thread, ThreadFn fn, void *argument)
+{
+    ThreadStart *start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) { return false; }
+    start->fn = fn;
+    start->argument = argument;
+
+    if (pthread_create(&thread->handle, NULL, ThreadEntry_, start) != 0) { free(start); return false; }
+    return true;
+}
+
+void JoinThread(Thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+uint32_t GetHardwareThreadCount()
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (uint32_t)count : 1;
+}
+
+void InitMutex(Mutex *mutex) { pthread_mutex_init(&mutex->lock, NULL); }
+void DestroyMutex(Mutex *mutex) { pthread_mutex_destroy(&mutex->lock); }
+void LockMutex(Mutex *mutex) { pthread_mutex_lock(&mutex->lock); }
+void UnlockMutex(Mutex *mutex) { pthread_mutex_unlock(&mutex->lock); }
+
+void InitCondition(Condition *condition) { pthread_cond_init(&condition->variable, NULL); }
+void DestroyCondition(Condition *condition) { pthread_cond_destroy(&condition->variable); }
+void WaitCondition(Condition *condition, Mutex *mutex) { pthread_cond_wait(&condition->variable, &mutex->lock); }
+void SignalCondition(Condition *condition) { pthread_cond_signal(&condition->variable); }
+void BroadcastCondition(Condition *condition) { pthread_cond_broadcast(&condition->variable); }
+
+size_t GetPageAllocationSize(size_t size, bool isHugePage)
+{
+#if defined(MADV_HUGEPAGE)
+    const size_t granularity = isHugePage ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+#else
+    (void)isHugePage;
+    const size_t granularity = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    return (size + granularity - 1) & ~(granularity - 1);
+}
+
+void* AllocatePages(size_t size, bool isHugePage)
+{
+#if defined(MAP_ANONYMOUS)
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#else
+    const int flags = MAP_PRIVATE | MAP_ANON;
+#endif
+    size = GetPageAllocationSize(size, isHugePage);
+#if defined(MADV_HUGEPAGE)
+    if (isHugePage)
+    {
+        // Over-map by one huge page and trim both ends so the block starts on
+        // a huge page boundary, otherwise the kernel can only use small pages.
+        uint8_t *mapping = (uint8_t*)mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mapping == MAP_FAILED) { return NULL; }
+
+        uint8_t *pages = (uint8_t*)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+        if (pages > mapping) { munmap(mapping, (size_t)(pages - mapping)); }
+        const size_t tail = (size_t)((mapping + size + HUGE_PAGE_SIZE) - (pages + size));
+        if (tail > 0) { munmap(pages + size, tail); }
+
+        // Advisory only, a kernel with transparent huge pages disabled keeps small pages
+        madvise(pages, size, MADV_HUGEPAGE);
+        return pages;
+    }
+#endif
+    void *pages = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return (pages == MAP_FAILED) ? NULL : pages;
+}
+
+void FreePages(void *pages, size_t size, bool isHugePage)
+{
+    if (pages) { munmap(pages, GetPageAllocationSize(size, isHugePage)); }
+}
+
+double GetPlatformTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + ((double)now.tv_nsec * 1.0e-9);
+}
+
+void SleepPlatform(double seconds)
+{
+    if (seconds <= 0.0) { return; }
+
+    struct timespec duration;
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (double)duration.tv_sec) * 1.0e9);
+    nanosleep(&duration, NULL);
+}
+
+#endif
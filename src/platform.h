@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Thin wrappers over the native threading and timing primitives. This header
+// must not pull in windows.h since its declarations collide with raylib.
+#if defined(_WIN32)
+    typedef struct Thread { void *handle; } Thread;
+    typedef struct Mutex { void *lock; } Mutex;             // SRWLOCK
+    typedef struct Condition { void *variable; } Condition; // CONDITION_VARIABLE
+#else
+    #include <pthread.h>
+    typedef struct Thread { pthread_t handle; } Thread;
+    typedef struct Mutex { pthread_mutex_t lock; } Mutex;
+    typedef struct Condition { pthread_cond_t variable; } Condition;
+#endif
+
+typedef void (*ThreadFn)(void *argument);
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)    // transparent huge page size on x86-64 and arm64 Linux
+
+// Interface methods
+// -----------------
+bool StartThread(Thread *thread, ThreadFn fn, void *argument);
+void JoinThread(Thread *thread);
+uint32_t GetHardwareThreadCount();
+
+void InitMutex(Mutex *mutex);
+void DestroyMutex(Mutex *mutex);
+void LockMutex(Mutex *mutex);
+void UnlockMutex(Mutex *mutex);
+
+void InitCondition(Condition *condition);
+void DestroyCondition(Condition *condition);
+void WaitCondition(Condition *condition, Mutex *mutex);
+void SignalCondition(Condition *condition);
+void BroadcastCondition(Condition *condition);
+
+// Page aligned, zeroed blocks straight from the virtual memory system. Huge
+// pages are a hint: on Linux the block is rounded to whole huge pages and
+// advised for transparent huge pages, elsewhere it falls back to normal pages.
+size_t GetPageAllocationSize(size_t size, bool isHugePage);    // bytes actually mapped for a request
+void* AllocatePages(size_t size, bool isHugePage);              // NULL on failure
+void FreePages(void *pages, size_t size, bool isHugePage);      // same size and hint as the allocation
+
+double GetPlatformTime();
+void SleepPlatform(double seconds);
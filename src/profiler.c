@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "profiler.h"
+
+#if defined(PARTICLE_PROFILE)
+
+const char *profilePhaseNames[PROFILE_PHASE_COUNT] = {
+    "life",
+    "integrate",
+    "clear hash",
+    "fill hash",
+    "wall contacts",
+    "self contacts",
+    "domain tiles",
+    "project",
+    "velocity",
+    "pack",
+    "render",
+};
+
+Profiler* ConstructProfiler()
+{
+    Profiler *profiler = (Profiler*)TrackedCalloc(MEMORY_TAG_SYSTEM, 1, sizeof(Profiler));
+    PASSERT(profiler, LOG_FATAL, "Failed to allocate profiler");
+    return profiler;
+}
+
+void DestructProfiler(Profiler *this)
+{
+    StopProfileCsv(this);
+    TrackedFree(this);
+}
+
+void RecordProfileFrame(Profiler *this, const double *phaseTimes)
+{
+    memcpy(this->history[this->frameCount % PROFILE_HISTORY], phaseTimes, sizeof(double) * PROFILE_PHASE_COUNT);
+
+    if (this->csv)
+    {
+        fprintf(this->csv, "%zu", this->frameCount);
+        for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { fprintf(this->csv, ",%.6f", phaseTimes[p] * 1000.0); }
+        fputc('\n', this->csv);
+    }
+
+    this->frameCount++;
+}
+
+void GetProfileAverages(const Profiler *this, double *averages)
+{
+    const size_t frames = (this->frameCount < PROFILE_HISTORY) ? this->frameCount : PROFILE_HISTORY;
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        double sum = 0.0;
+        for (size_t f = 0; f < frames; f++) { sum += this->history[f][p]; }
+        averages[p] = (frames > 0) ? (sum / (double)frames) : 0.0;
+    }
+}
+
+bool StartProfileCsv(Profiler *this, const char *path)
+{
+    StopProfileCsv(this);
+
+    this->csv = fopen(path, "w");
+    PASSERTRETURNVALUE(this->csv, false, LOG_WARNING, "Failed to open profile CSV %s", path);
+
+    // One row per frame, phase times in milliseconds
+    fprintf(this->csv, "frame");
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { fprintf(this->csv, ",%s", profilePhaseNames[p]); }
+    fputc('\n', this->csv);
+    TraceLog(LOG_INFO, "PROFILER: Streaming phase times to %s", path);
+    return true;
+}
+
+void StopProfileCsv(Profiler *this)
+{
+    if (!this->csv) { return; }
+
+    fclose(this->csv);
+    this->csv = NULL;
+}
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawProfilerOverlay(const Profiler *this, int x, int y)
+{
+    double averages[PROFILE_PHASE_COUNT];
+    GetProfileAverages(this, averages);
+
+    double total = 0.0;
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++) { total += averages[p]; }
+
+    const int rowHeight = 10, barWidth = 100;
+    const int height = ((PROFILE_PHASE_COUNT + 1) * rowHeight) + 6;
+    DrawRectangle(x, y, 260, height, Fade(SKYBLUE, 0.5f));
+    DrawRectangleLines(x, y, 260, height, BLUE);
+    DrawText(TextFormat("Phases (avg %i frames)%s", PROFILE_HISTORY, this->csv ? " CSV" : ""), x + 5, y + 2, 10, DARKGRAY);
+
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        const int rowY = y + 2 + ((p + 1) * rowHeight);
+        const float share = (total > 0.0) ? (float)(averages[p] / total) : 0.0f;
+        DrawText(TextFormat("%-13s %6.3f ms", profilePhaseNames[p], averages[p] * 1000.0), x + 5, rowY, 10, DARKGRAY);
+        DrawRectangle(x + 150, rowY + 1, (int)(share * barWidth), rowHeight - 2, BLUE);
+    }
+}
+#endif
+
+#endif // PARTICLE_PROFILE
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+#include "config.h"
+#include "platform.h"
+#include "trace.h"
+
+#define PROFILE_HISTORY 120     // frames averaged by the overlay
+
+// Phases
+// -----------------
+typedef enum ProfilePhase
+{
+    PROFILE_PHASE_LIFE,
+    PROFILE_PHASE_INTEGRATE,
+    PROFILE_PHASE_CLEAR_HASH,
+    PROFILE_PHASE_FILL_HASH,
+    PROFILE_PHASE_WALL_CONTACTS,
+    PROFILE_PHASE_SELF_CONTACTS,    // particle and collider contacts
+    PROFILE_PHASE_DOMAIN,           // tiled hash, contacts and projection when decomposed
+    PROFILE_PHASE_PROJECT,
+    PROFILE_PHASE_VELOCITY,
+    PROFILE_PHASE_PACK,             // render snapshot packing on the simulation thread
+    PROFILE_PHASE_RENDER,
+    PROFILE_PHASE_COUNT,
+}ProfilePhase;
+
+// Scoped timers
+// -----------------
+// PROFILE_SCOPE(times, phase) { ... } adds the wall time of the block to
+// times[phase] and records it as a trace event while a trace is recording.
+// Without PARTICLE_PROFILE the macro expands to nothing and the block is a
+// plain compound statement. The block must not break or return.
+#if defined(PARTICLE_PROFILE)
+    #define PROFILE_SCOPE(times, phase) \
+        for (double profileStart_ = GetPlatformTime(), profileOnce_ = 1.0; profileOnce_ > 0.0; \
+            EndProfileScope_((times), (phase), profileStart_), profileOnce_ = 0.0)
+#else
+    #define PROFILE_SCOPE(times, phase)
+#endif
+
+#if defined(PARTICLE_PROFILE)
+
+// Profiler
+// -----------------
+// Collects the phase times of one frame at a time on the render thread, keeps
+// a rolling history for the overlay and optionally streams every frame to CSV.
+typedef struct Profiler
+{
+    double history[PROFILE_HISTORY][PROFILE_PHASE_COUNT];
+    size_t frameCount;
+    FILE *csv;
+}Profiler;
+
+// declare extern variables
+// -----------------
+extern const char *profilePhaseNames[PROFILE_PHASE_COUNT];
+
+// Private methods
+// -----------------
+static inline void EndProfileScope_(double *times, ProfilePhase phase, double start)
+{
+    const double end = GetPlatformTime();
+    times[phase] += end - start;
+    RecordTraceEvent(profilePhaseNames[phase], start, end);
+}
+
+// Interface methods
+// -----------------
+Profiler* ConstructProfiler();
+void DestructProfiler(Profiler *this);
+
+void RecordProfileFrame(Profiler *this, const double *phaseTimes);
+void GetProfileAverages(const Profiler *this, double *averages);
+
+bool StartProfileCsv(Profiler *this, const char *path);
+void StopProfileCsv(Profiler *this);
+static inline bool IsProfileCsvOpen(const Profiler *this) { return this->csv != NULL; }
+
+#if !defined(PARTICLE_HEADLESS)
+void DrawProfilerOverlay(const Profiler *this, int x, int y);
+#endif
+
+#endif // PARTICLE_PROFILE
@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "renderer.h"
+
+#include <stddef.h>
+#include "particle.h"
+#include "simd.h"
+
+#ifndef RL_UNSIGNED_SHORT
+    #define RL_UNSIGNED_SHORT 0x1403    // GL_UNSIGNED_SHORT
+#endif
+
+static Vector2 UnpackInstancePosition_(const uint16_t packed[2], Rectangle bounds)
+{
+    return (Vector2){
+        bounds.x + (bounds.width * ((float)packed[0] / (float)UINT16_MAX)),
+        bounds.y + (bounds.height * ((float)packed[1] / (float)UINT16_MAX)) };
+}
+
+static void DrawParticleCircles_(const ParticleInstance *instances, size_t count, Rectangle bounds, float alpha)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vector2 prevPosition = UnpackInstancePosition_(instances[i].prevPosition, bounds);
+        const Vector2 position = UnpackInstancePosition_(instances[i].position, bounds);
+        const ParticlePalette *palette = &particlePalettes[instances[i].type];
+        const Color color = ColorLerp(palette->birthColor, palette->deathColor, (float)instances[i].age / (float)UINT16_MAX);
+        DrawCircleV(Vector2Lerp(prevPosition, position, alpha), PARTICLE_RADIUS, color);
+    }
+}
+
+static void SetPaletteUniforms_(const ParticleRenderer *this)
+{
+    PASSERT(PARTICLE_TYPE_COUNT <= MAX_PALETTE_TYPES, LOG_WARNING, "Particle types exceed MAX_PALETTE_TYPES.");
+    const int count = (PARTICLE_TYPE_COUNT < MAX_PALETTE_TYPES) ? PARTICLE_TYPE_COUNT : MAX_PALETTE_TYPES;
+
+    Vector4 birthColors[MAX_PALETTE_TYPES], deathColors[MAX_PALETTE_TYPES];
+    for (int t = 0; t < count; t++)
+    {
+        birthColors[t] = ColorNormalize(particlePalettes[t].birthColor);
+        deathColors[t] = ColorNormalize(particlePalettes[t].deathColor);
+    }
+    rlSetUniform(this->birthColorsLoc, birthColors, RL_SHADER_UNIFORM_VEC4, count);
+    rlSetUniform(this->deathColorsLoc, deathColors, RL_SHADER_UNIFORM_VEC4, count);
+}
+
+static Rectangle GetCameraView_(Camera2D camera)
+{
+    // World space bounds of the screen corners, valid for rotated cameras too
+    const float width = (float)GetScreenWidth(), height = (float)GetScreenHeight();
+    const Vector2 corners[4] = {
+        GetScreenToWorld2D((Vector2){ 0.0f, 0.0f }, camera),
+        GetScreenToWorld2D((Vector2){ width, 0.0f }, camera),
+        GetScreenToWorld2D((Vector2){ 0.0f, height }, camera),
+        GetScreenToWorld2D((Vector2){ width, height }, camera) };
+
+    Vector2 min = corners[0], max = corners[0];
+    for (int i = 1; i < 4; i++)
+    {
+        min = Vector2Min(min, corners[i]);
+        max = Vector2Max(max, corners[i]);
+    }
+    return (Rectangle){ min.x, min.y, max.x - min.x, max.y - min.y };
+}
+
+static void DrawCellSplats_(ParticleRenderer *this, const ParticleRenderGrid *grid, int c0, int c1, int r0, int r1)
+{
+    // One quad per occupied cell, opacity follows the fraction of a close
+    // packed cell that is filled.
+    const float capacity = (grid->cellSize * grid->cellSize) / (4.0f * PARTICLE_RADIUS * PARTICLE_RADIUS);
+    const Vector2 size = { grid->cellSize, grid->cellSize };
+    for (int r = r0; r <= r1; r++)
+    {
+        for (int c = c0; c <= c1; c++)
+        {
+            const int cell = (r * grid->columns) + c;
+            const uint32_t count = grid->cellStart[cell + 1] - grid->cellStart[cell];
+            if (count == 0) { continue; }
+
+            const ParticlePalette *palette = &particlePalettes[grid->cellTypes[cell]];
+            const Color color = ColorLerp(palette->birthColor, palette->deathColor, grid->cellAges[cell]);
+            const Vector2 position = { grid->origin.x + (c * grid->cellSize), grid->origin.y + (r * grid->cellSize) };
+            DrawRectangleV(position, size, Fade(color, ((float)color.a / 255.0f) * fminf((float)count / capacity, 1.0f)));
+            this->stats.drawnCells++;
+        }
+    }
+}
+
+ParticleRenderer* ConstructParticleRenderer(const char *vsFileName, const char *fsFileName)
+{
+    ParticleRenderer *renderer = (ParticleRenderer*)TrackedMalloc(MEMORY_TAG_RENDERER, sizeof(ParticleRenderer));
+    PASSERT(renderer, LOG_FATAL, "Failed to allocate particle renderer");
+    if(!renderer) { return NULL; }
+
+    *renderer = (ParticleRenderer){ 0 };
+
+    // Instancing needs vertex arrays and a programmable pipeline
+    const int version = rlGetVersion();
+    if (version != RL_OPENGL_33 && version != RL_OPENGL_43)
+    {
+        TraceLog(LOG_WARNING, "Instanced particle rendering requires OpenGL 3.3. Falling back to DrawCircleV.");
+        return renderer;
+    }
+
+    renderer->shader = LoadShader(vsFileName, fsFileName);
+    if (renderer->shader.id == rlGetShaderIdDefault())
+    {
+        TraceLog(LOG_WARNING, "Failed to load particle shader. Falling back to DrawCircleV.");
+        return renderer;
+    }
+    renderer->mvpLoc    = GetShaderLocation(renderer->shader, "mvp");
+    renderer->radiusLoc = GetShaderLocation(renderer->shader, "radius");
+    renderer->alphaLoc  = GetShaderLocation(renderer->shader, "alpha");
+    renderer->boundsLoc = GetShaderLocation(renderer->shader, "bounds");
+    renderer->birthColorsLoc = GetShaderLocation(renderer->shader, "birthColors");
+    renderer->deathColorsLoc = GetShaderLocation(renderer->shader, "deathColors");
+
+    // Two triangles covering the unit quad, shared by all vertex arrays
+    const float corners[] = {
+        -1.0f, -1.0f,    1.0f, -1.0f,    1.0f,  1.0f,
+        -1.0f, -1.0f,    1.0f,  1.0f,   -1.0f,  1.0f,
+    };
+
+    for (int r = 0; r < PARTICLE_RENDERER_RING_SIZE; r++)
+    {
+        renderer->vaos[r] = rlLoadVertexArray();
+        if (renderer->vaos[r] == 0)
+        {
+            TraceLog(LOG_WARNING, "Vertex arrays not supported. Falling back to DrawCircleV.");
+            UnloadShader(renderer->shader);
+            return renderer;
+        }
+        rlEnableVertexArray(renderer->vaos[r]);
+
+        if (r == 0) { renderer->cornerVbo = rlLoadVertexBuffer(corners, sizeof(corners), false); }
+        else { rlEnableVertexBuffer(renderer->cornerVbo); }
+        rlSetVertexAttribute(PARTICLE_ATTRIBUTE_CORNER, 2, RL_FLOAT, false, 0, 0);
+        rlEnableVertexAttribute(PARTICLE_ATTRIBUTE_CORNER);
+
+        // Interleaved instance buffer sized for the whole pool
+        const int stride = sizeof(ParticleInstance);
+        renderer->instanceVbos[r] = rlLoadVertexBuffer(NULL, stride * MAX_PARTICLE_COUNT, true);
+        rlSetVertexAttribute(PARTICLE_ATTRIBUTE_PREV_POSITION, 2, RL_UNSIGNED_SHORT, true, stride,
+            offsetof(ParticleInstance, prevPosition));
+        rlSetVertexAttribute(PARTICLE_ATTRIBUTE_POSITION, 2, RL_UNSIGNED_SHORT, true, stride,
+            offsetof(ParticleInstance, position));
+        rlSetVertexAttribute(PARTICLE_ATTRIBUTE_AGE, 1, RL_UNSIGNED_SHORT, true, stride,
+            offsetof(ParticleInstance, age));
+        rlSetVertexAttribute(PARTICLE_ATTRIBUTE_TYPE, 1, RL_UNSIGNED_BYTE, false, stride,
+            offsetof(ParticleInstance, type));
+        for (int a = PARTICLE_ATTRIBUTE_PREV_POSITION; a <= PARTICLE_ATTRIBUTE_TYPE; a++)
+        {
+            rlSetVertexAttributeDivisor(a, 1);
+            rlEnableVertexAttribute(a);
+        }
+
+        rlDisableVertexArray();
+    }
+
+    renderer->isInstanced = true;
+    return renderer;
+}
+
+void DestructParticleRenderer(ParticleRenderer *this)
+{
+    if (this->isInstanced)
+    {
+        for (int r = 0; r < PARTICLE_RENDERER_RING_SIZE; r++)
+        {
+            rlUnloadVertexBuffer(this->instanceVbos[r]);
+            rlUnloadVertexArray(this->vaos[r]);
+        }
+        rlUnloadVertexBuffer(this->cornerVbo);
+        UnloadShader(this->shader);
+    }
+    TrackedFree(this);
+}
+
+void PackParticleInstances(ParticleInstance *instances, ParticleRenderGrid *grid, Rectangle bounds, const ParticlePool *particles)
+{
+    // Grid covering the bounds, coarsened until it fits MAX_RENDER_CELLS
+    float cellSize = RENDER_CELL_SIZE;
+    while ((ceilf(bounds.width / cellSize) * ceilf(bounds.height / cellSize)) > MAX_RENDER_CELLS) { cellSize *= 2.0f; }
+    grid->origin = (Vector2){ bounds.x, bounds.y };
+    grid->cellSize = cellSize;
+    grid->columns = (int)ceilf(bounds.width / cellSize);
+    grid->rows = (int)ceilf(bounds.height / cellSize);
+    const int cellCount = grid->columns * grid->rows;
+
+    const size_t n = particles->activeCount;
+    uint16_t cells[MAX_PARTICLE_COUNT];
+    uint32_t cursor[MAX_RENDER_CELLS];
+    float ages[MAX_PARTICLE_COUNT];
+
+    // Normalized ages drive the birth to death color lerp in the shader and
+    // in the fallback paths
+    const SimdKernels *simd = GetSimdKernels();
+    PARTICLE_RUN_FOR(run, particles, 0, n) { simd->Divide(&ages[run.first], run.lifespans, run.lifetimes, run.count); }
+
+    // Count particles per cell, the prefix sum turns counts into start indices
+    memset(grid->cellStart, 0, sizeof(uint32_t) * (cellCount + 1));
+    memset(grid->cellAges, 0, sizeof(float) * cellCount);
+    for (size_t i = 0; i < n; i++)
+    {
+        const Vector2 position = GetParticlePosition(particles, i);
+        const int cx = Clamp((int)((position.x - grid->origin.x) / cellSize), 0, grid->columns - 1);
+        const int cy = Clamp((int)((position.y - grid->origin.y) / cellSize), 0, grid->rows - 1);
+        cells[i] = (uint16_t)((cy * grid->columns) + cx);
+        grid->cellStart[cells[i] + 1]++;
+    }
+    for (int c = 0; c < cellCount; c++) { grid->cellStart[c + 1] += grid->cellStart[c]; }
+    memcpy(cursor, grid->cellStart, sizeof(uint32_t) * cellCount);
+
+    // Quantize to the nearest step, positions outside of the bounds clamp to the edge
+    const float sx = (float)UINT16_MAX / bounds.width, sy = (float)UINT16_MAX / bounds.height;
+    for (size_t i = 0; i < n; i++)
+    {
+        const Vector2 prevPosition = GetParticleStepPosition(particles, i), position = GetParticlePosition(particles, i);
+        const float age = ages[i];
+        ParticleInstance *instance = &instances[cursor[cells[i]]++];
+
+        instance->prevPosition[0] = (uint16_t)Clamp(((prevPosition.x - bounds.x) * sx) + 0.5f, 0.0f, (float)UINT16_MAX);
+        instance->prevPosition[1] = (uint16_t)Clamp(((prevPosition.y - bounds.y) * sy) + 0.5f, 0.0f, (float)UINT16_MAX);
+        instance->position[0] = (uint16_t)Clamp(((position.x - bounds.x) * sx) + 0.5f, 0.0f, (float)UINT16_MAX);
+        instance->position[1] = (uint16_t)Clamp(((position.y - bounds.y) * sy) + 0.5f, 0.0f, (float)UINT16_MAX);
+        instance->age = (uint16_t)Clamp((age * (float)UINT16_MAX) + 0.5f, 0.0f, (float)UINT16_MAX);
+        instance->type = PARTICLE_TYPE(particles, i);
+        instance->padding = 0;
+
+        grid->cellAges[cells[i]] += age;
+        grid->cellTypes[cells[i]] = PARTICLE_TYPE(particles, i);
+    }
+    for (int c = 0; c < cellCount; c++)
+    {
+        const uint32_t count = grid->cellStart[c + 1] - grid->cellStart[c];
+        if (count > 0) { grid->cellAges[c] /= (float)count; }
+    }
+}
+
+void DrawParticleInstances(ParticleRenderer *this, const ParticleInstance *instances, const ParticleRenderGrid *grid,
+    Rectangle bounds, Camera2D camera, float alpha)
+{
+    this->stats = (ParticleRendererStats){ 0 };
+    if (grid->cellStart[grid->columns * grid->rows] == 0) { return; }
+
+    // Visible cells. Instances are bucketed by their current position, the
+    // margin covers the radius and the interpolation back to the previous step.
+    const Rectangle view = GetCameraView_(camera);
+    const float margin = grid->cellSize;
+    const int c0 = Clamp((int)floorf((view.x - margin - grid->origin.x) / grid->cellSize), 0, grid->columns - 1);
+    const int c1 = Clamp((int)floorf((view.x + view.width + margin - grid->origin.x) / grid->cellSize), 0, grid->columns - 1);
+    const int r0 = Clamp((int)floorf((view.y - margin - grid->origin.y) / grid->cellSize), 0, grid->rows - 1);
+    const int r1 = Clamp((int)floorf((view.y + view.height + margin - grid->origin.y) / grid->cellSize), 0, grid->rows - 1);
+
+    // Level of detail. Sub-pixel particles are replaced by per-cell density quads.
+    if ((2.0f * PARTICLE_RADIUS * camera.zoom) < PARTICLE_LOD_PIXEL_SIZE)
+    {
+        this->stats.isSplatting = true;
+        DrawCellSplats_(this, grid, c0, c1, r0, r1);
+        return;
+    }
+
+    if (!this->isInstanced)
+    {
+        for (int r = r0; r <= r1; r++)
+        {
+            const uint32_t begin = grid->cellStart[(r * grid->columns) + c0];
+            const uint32_t end = grid->cellStart[(r * grid->columns) + c1 + 1];
+            DrawParticleCircles_(&instances[begin], end - begin, bounds, alpha);
+            this->stats.drawnInstances += end - begin;
+        }
+        return;
+    }
+
+    // Upload the visible run of each row back to back, merging runs that are
+    // adjacent in the instance array.
+    this->ringIndex = (this->ringIndex + 1) % PARTICLE_RENDERER_RING_SIZE;
+    const uint32_t vbo = this->instanceVbos[this->ringIndex];
+    uint32_t runBegin = 0, runEnd = 0;
+    size_t uploaded = 0;
+    for (int r = r0; r <= r1 + 1; r++)
+    {
+        const bool isLastRow = (r > r1);
+        const uint32_t begin = isLastRow ? 0 : grid->cellStart[(r * grid->columns) + c0];
+        const uint32_t end = isLastRow ? 0 : grid->cellStart[(r * grid->columns) + c1 + 1];
+        if (!isLastRow && begin == runEnd && runEnd > runBegin) { runEnd = end; continue; }
+
+        if (runEnd > runBegin)
+        {
+            rlUpdateVertexBuffer(vbo, &instances[runBegin], (int)(sizeof(ParticleInstance) * (runEnd - runBegin)),
+                (int)(sizeof(ParticleInstance) * uploaded));
+            uploaded += runEnd - runBegin;
+        }
+        runBegin = begin;
+        runEnd = end;
+    }
+    this->stats.drawnInstances = uploaded;
+    if (uploaded == 0) { return; }
+
+    // Flush the batched shapes drawn so far to keep the draw order
+    rlDrawRenderBatchActive();
+
+    // The modelview matrix already holds the 2D camera transform
+    const Matrix mvp = MatrixMultiply(MatrixMultiply(rlGetMatrixTransform(), rlGetMatrixModelview()), rlGetMatrixProjection());
+    const float radius = PARTICLE_RADIUS;
+    const float boundsValue[4] = { bounds.x, bounds.y, bounds.width, bounds.height };
+
+    rlEnableShader(this->shader.id);
+    rlSetUniformMatrix(this->mvpLoc, mvp);
+    rlSetUniform(this->radiusLoc, &radius, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(this->alphaLoc, &alpha, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(this->boundsLoc, boundsValue, RL_SHADER_UNIFORM_VEC4, 1);
+    SetPaletteUniforms_(this);
+
+    rlEnableVertexArray(this->vaos[this->ringIndex]);
+    rlDrawVertexArrayInstanced(0, 6, (int)uploaded);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
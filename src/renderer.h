@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "raylib.h"
+
+#define PARTICLE_RENDERER_RING_SIZE 3   // instance buffers in flight
+#define MAX_PALETTE_TYPES 8             // must match the palette array size in particle.vs
+#define MAX_RENDER_CELLS 4096           // culling grid cells, the cell size grows to fit the bounds
+#define RENDER_CELL_SIZE 16.0f          // preferred culling cell size in world units
+#define PARTICLE_LOD_PIXEL_SIZE 1.0f    // on screen particle diameter below which cells are splatted
+
+// Forward declaration
+typedef struct ParticlePool ParticlePool;
+
+// Instanced particle renderer
+// -----------------
+// Draws every particle as one instance of a unit quad in a single draw call.
+// The vertex shader interpolates between the previous and current position,
+// evaluates the lifetime color from the per-type palette and the fragment
+// shader masks the quad to a circle. Without vertex array or
+// shader support the renderer falls back to one DrawCircleV per particle.
+typedef enum ParticleRendererAttribute
+{
+    PARTICLE_ATTRIBUTE_CORNER,          // per vertex quad corner in [-1, 1]
+    PARTICLE_ATTRIBUTE_PREV_POSITION,   // per instance
+    PARTICLE_ATTRIBUTE_POSITION,        // per instance
+    PARTICLE_ATTRIBUTE_AGE,             // per instance, normalized lifespan / lifetime
+    PARTICLE_ATTRIBUTE_TYPE,            // per instance, palette index
+}ParticleRendererAttribute;
+
+// GPU-ready instance, uploaded without conversion. Positions are 16-bit
+// unsigned normalized coordinates within the instance bounds, which keeps
+// sub-pixel precision across the whole boundary box at half the size of two
+// floats.
+typedef struct ParticleInstance
+{
+    uint16_t prevPosition[2];
+    uint16_t position[2];
+    uint16_t age;
+    uint8_t type;
+    uint8_t padding;
+}ParticleInstance;
+
+// Culling grid
+// -----------------
+// Instances are bucketed by a counting sort into a dense row-major grid over
+// the instance bounds, so the instances of any run of cells in one row are
+// contiguous. Drawing only touches the cells inside the camera view.
+typedef struct ParticleRenderGrid
+{
+    Vector2 origin;
+    float cellSize;
+    int columns, rows;
+
+    uint32_t cellStart[MAX_RENDER_CELLS + 1];   // instances of cell c are [cellStart[c], cellStart[c + 1])
+    float cellAges[MAX_RENDER_CELLS];           // mean normalized age, used by the splat LOD
+    uint8_t cellTypes[MAX_RENDER_CELLS];
+}ParticleRenderGrid;
+
+typedef struct ParticleRendererStats
+{
+    bool isSplatting;       // cells drawn as density quads instead of particles
+    size_t drawnInstances;
+    size_t drawnCells;
+}ParticleRendererStats;
+
+typedef struct ParticleRenderer
+{
+    bool isInstanced;
+    ParticleRendererStats stats;
+
+    Shader shader;
+    int mvpLoc;
+    int radiusLoc;
+    int alphaLoc;
+    int boundsLoc;
+    int birthColorsLoc;
+    int deathColorsLoc;
+
+    // Each frame writes the next vertex array's instance buffer so the driver
+    // never has to wait for the GPU to finish reading the previous frame.
+    uint32_t cornerVbo;
+    uint32_t vaos[PARTICLE_RENDERER_RING_SIZE];
+    uint32_t instanceVbos[PARTICLE_RENDERER_RING_SIZE];
+    uint32_t ringIndex;
+}ParticleRenderer;
+
+// Private methods
+// -----------------
+static Vector2 UnpackInstancePosition_(const uint16_t packed[2], Rectangle bounds);
+static void DrawParticleCircles_(const ParticleInstance *instances, size_t count, Rectangle bounds, float alpha);
+static void SetPaletteUniforms_(const ParticleRenderer *this);
+static Rectangle GetCameraView_(Camera2D camera);
+static void DrawCellSplats_(ParticleRenderer *this, const ParticleRenderGrid *grid, int c0, int c1, int r0, int r1);
+
+// Interface methods
+// -----------------
+ParticleRenderer* ConstructParticleRenderer(const char *vsFileName, const char *fsFileName);
+void DestructParticleRenderer(ParticleRenderer *this);
+
+void PackParticleInstances(ParticleInstance *instances, ParticleRenderGrid *grid, Rectangle bounds, const ParticlePool *particles);
+void DrawParticleInstances(ParticleRenderer *this, const ParticleInstance *instances, const ParticleRenderGrid *grid,
+    Rectangle bounds, Camera2D camera, float alpha);
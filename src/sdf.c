@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "sdf.h"
+
+#include "collider.h"
+
+static float CalculateColliderDistance_(const ColliderSet *colliders, Vector2 position)
+{
+    float distance = INFINITY;
+    for (size_t i = 0; i < arrlenu(colliders->colliders); i++)
+    {
+        const Collider *c = &colliders->colliders[i];
+        switch (c->type)
+        {
+        case COLLIDER_SEGMENT:
+        {
+            // Segments are thin two-sided walls and have no interior
+            const Vector2 segment = Vector2Subtract(c->end, c->start);
+            const float lengthSqr = Vector2LengthSqr(segment);
+            const float t = (lengthSqr > EPSILON) ?
+                Clamp(Vector2DotProduct(Vector2Subtract(position, c->start), segment) / lengthSqr, 0.0f, 1.0f) : 0.0f;
+            distance = fminf(distance, Vector2Distance(position, Vector2Add(c->start, Vector2Scale(segment, t))));
+            break;
+        }
+        case COLLIDER_CIRCLE:
+            distance = fminf(distance, Vector2Distance(position, c->center) - c->radius);
+            break;
+        default:
+            break;
+        }
+    }
+    return distance;
+}
+
+SignedDistanceField* ConstructSignedDistanceField(Vector2 origin, float cellSize, int width, int height)
+{
+    PASSERT((width > 1 && height > 1), LOG_ERROR, "Signed distance field requires at least 2x2 nodes.");
+    PASSERT((cellSize > EPSILON), LOG_ERROR, "Signed distance field cell size must be greater than zero.");
+
+    SignedDistanceField *field = (SignedDistanceField*)TrackedMalloc(MEMORY_TAG_FIELD, sizeof(SignedDistanceField));
+    PASSERT(field, LOG_FATAL, "Failed to allocate signed distance field");
+    if(!field) { return NULL; }
+
+    field->origin   = origin;
+    field->cellSize = cellSize;
+    field->width    = width;
+    field->height   = height;
+
+    field->distances = (float*)TrackedMalloc(MEMORY_TAG_FIELD, sizeof(float) * width * height);
+    PASSERT(field->distances, LOG_FATAL, "Failed to allocate signed distance field grid");
+    if(!field->distances) { TrackedFree(field); return NULL; }
+
+    for (int i = 0; i < (width * height); i++) { field->distances[i] = INFINITY; }
+
+    return field;
+}
+
+void DestructSignedDistanceField(SignedDistanceField *this)
+{
+    TrackedFree(this->distances);
+    TrackedFree(this);
+}
+
+void BakeSignedDistanceFieldFromColliders(SignedDistanceField *this, const ColliderSet *colliders, Rectangle container)
+{
+    for (int y = 0; y < this->height; y++)
+    {
+        for (int x = 0; x < this->width; x++)
+        {
+            const Vector2 p = { this->origin.x + (x * this->cellSize), this->origin.y + (y * this->cellSize) };
+
+            // Everything outside of the container rectangle is solid
+            const float containerDistance = fminf(
+                fminf(p.x - container.x, (container.x + container.width) - p.x),
+                fminf(p.y - container.y, (container.y + container.height) - p.y));
+
+            this->distances[(y * this->width) + x] = fminf(containerDistance, CalculateColliderDistance_(colliders, p));
+        }
+    }
+}
+
+float SampleSignedDistanceField(const SignedDistanceField *this, Vector2 position, Vector2 *gradient)
+{
+    const float inverseCellSize = 1.0f / this->cellSize;
+    const float gx = (position.x - this->origin.x) * inverseCellSize;
+    const float gy = (position.y - this->origin.y) * inverseCellSize;
+    const int x0 = (int)floorf(gx), y0 = (int)floorf(gy);
+    const float fx = Clamp(gx - (float)x0, 0.0f, 1.0f), fy = Clamp(gy - (float)y0, 0.0f, 1.0f);
+
+    const float d00 = GetFieldValue_(this, x0, y0),     d10 = GetFieldValue_(this, x0 + 1, y0);
+    const float d01 = GetFieldValue_(this, x0, y0 + 1), d11 = GetFieldValue_(this, x0 + 1, y0 + 1);
+
+    // Bilinear interpolation and its analytic derivative
+    if (gradient)
+    {
+        gradient->x = (((d10 - d00) * (1.0f - fy)) + ((d11 - d01) * fy)) * inverseCellSize;
+        gradient->y = (((d01 - d00) * (1.0f - fx)) + ((d11 - d10) * fx)) * inverseCellSize;
+    }
+    return Lerp(Lerp(d00, d10, fx), Lerp(d01, d11, fx), fy);
+}
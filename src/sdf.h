@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "raylib.h"
+
+// Forward declaration
+typedef struct ColliderSet ColliderSet;
+
+// Signed distance field
+// -----------------
+// Distances are sampled at grid nodes `origin + (x, y) * cellSize`. Values are
+// positive in free space and negative inside solid geometry.
+typedef struct SignedDistanceField
+{
+    Vector2 origin;
+    float cellSize;
+    int width, height;
+
+    float *distances;
+}SignedDistanceField;
+
+// Private methods
+// -----------------
+static float CalculateColliderDistance_(const ColliderSet *colliders, Vector2 position);
+
+static inline float GetFieldValue_(const SignedDistanceField *this, int x, int y)
+{
+    x = (x < 0) ? 0 : ((x >= this->width) ? this->width - 1 : x);
+    y = (y < 0) ? 0 : ((y >= this->height) ? this->height - 1 : y);
+    return this->distances[(y * this->width) + x];
+}
+
+// Interface methods
+// -----------------
+SignedDistanceField* ConstructSignedDistanceField(Vector2 origin, float cellSize, int width, int height);
+void DestructSignedDistanceField(SignedDistanceField *this);
+
+void BakeSignedDistanceFieldFromColliders(SignedDistanceField *this, const ColliderSet *colliders, Rectangle container);
+
+float SampleSignedDistanceField(const SignedDistanceField *this, Vector2 position, Vector2 *gradient);
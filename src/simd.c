@@ -0,0 +1,598 @@
+#include "pch.h"
+#include "simd.h"
+
+#include <stdatomic.h>
+
+#if defined(SIMD_SSE2)
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+const char *simdLevelNames[SIMD_LEVEL_COUNT] = {
+    "scalar",
+    "sse2",
+    "avx2",
+};
+
+// IntegrateForces variants
+// -----------------
+// Each SimdForceTerm mask gets its own function per level, with the mask and
+// the stream kind folded into the body at compile time. The inner loops then
+// carry neither a branch on the force set nor a walk over a force list.
+#define SIMD_INTEGRATE_VARIANT_(terms, Level, ATTRIBUTE, BODY) \
+    ATTRIBUTE static void IntegrateForces##terms##Level##_(const SimdIntegrateArgs *args) \
+    { \
+        if (args->isInterleaved) { BODY(args, terms, true); } \
+        else { BODY(args, terms, false); } \
+    }
+
+#define SIMD_INTEGRATE_VARIANTS_(Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(0, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(1, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(2, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(3, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(4, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(5, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(6, Level, ATTRIBUTE, BODY) \
+    SIMD_INTEGRATE_VARIANT_(7, Level, ATTRIBUTE, BODY)
+
+#define SIMD_INTEGRATE_TABLE_(Level) { \
+    IntegrateForces0##Level##_, IntegrateForces1##Level##_, IntegrateForces2##Level##_, IntegrateForces3##Level##_, \
+    IntegrateForces4##Level##_, IntegrateForces5##Level##_, IntegrateForces6##Level##_, IntegrateForces7##Level##_ }
+
+_Static_assert(SIMD_FORCE_TERM_COMBINATIONS == 8, "SIMD_INTEGRATE_VARIANTS_ instantiates 8 term masks");
+
+SIMD_INLINE void IntegrateForcesScalarBody_(const SimdIntegrateArgs *args, size_t begin, unsigned terms, bool isInterleaved)
+{
+    float *velocities = args->velocities, *positions = args->positions, *previous = args->previous;
+    const float *masses = args->masses, *forces = args->forces;
+    const float gravityEven = args->gravityEven, gravityOdd = args->gravityOdd, drag = args->drag;
+    const float deltaTime = args->deltaTime;
+    for (size_t i = begin; i < args->laneCount; i++)
+    {
+        const float mass = masses[isInterleaved ? (i >> 1) : i];
+        float force = (terms & SIMD_FORCE_LANES) ? forces[i] : 0.0f;
+        if (terms & SIMD_FORCE_GRAVITY) { force += mass * ((i & 1) ? gravityOdd : gravityEven); }
+        if (terms & SIMD_FORCE_DRAG) { force += velocities[i] * drag; }
+
+        const float velocity = velocities[i] + force * (deltaTime * (1.0f / mass));
+        const float position = positions[i];
+        velocities[i] = velocity;
+        previous[i] = position;
+        positions[i] = position + velocity * deltaTime;
+    }
+}
+
+#define INTEGRATE_FORCES_SCALAR_(args, terms, isInterleaved) IntegrateForcesScalarBody_(args, 0, terms, isInterleaved)
+SIMD_INTEGRATE_VARIANTS_(Scalar, , INTEGRATE_FORCES_SCALAR_)
+
+SIMD_INLINE void SumGravityDragScalarBody_(float *forces, const SimdIntegrateArgs *args, size_t begin, bool isInterleaved)
+{
+    const float *velocities = args->velocities, *masses = args->masses;
+    const float gravityEven = args->gravityEven, gravityOdd = args->gravityOdd, drag = args->drag;
+    for (size_t i = begin; i < args->laneCount; i++)
+    {
+        const float mass = masses[isInterleaved ? (i >> 1) : i];
+        forces[i] = (0.0f + mass * ((i & 1) ? gravityOdd : gravityEven)) + velocities[i] * drag;
+    }
+}
+
+static void SumGravityDragScalar_(float *forces, const SimdIntegrateArgs *args)
+{
+    if (args->isInterleaved) { SumGravityDragScalarBody_(forces, args, 0, true); }
+    else { SumGravityDragScalarBody_(forces, args, 0, false); }
+}
+
+#if defined(SIMD_SSE2)
+SIMD_INLINE void IntegrateForcesSse2Body_(const SimdIntegrateArgs *args, unsigned terms, bool isInterleaved)
+{
+    float *velocities = args->velocities, *positions = args->positions, *previous = args->previous;
+    const float *masses = args->masses, *forces = args->forces;
+    const size_t laneCount = args->laneCount;
+    const __m128 one = _mm_set1_ps(1.0f), dt = _mm_set1_ps(args->deltaTime), drag = _mm_set1_ps(args->drag);
+    const __m128 gravity = _mm_setr_ps(args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd);
+    size_t i = 0;
+    for (; i + 4 <= laneCount; i += 4)
+    {
+        __m128 mass;
+        if (isInterleaved)
+        {
+            const __m128 pair = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(masses + (i >> 1)));
+            mass = _mm_unpacklo_ps(pair, pair);
+        }
+        else { mass = _mm_loadu_ps(masses + i); }
+
+        const __m128 v = _mm_loadu_ps(velocities + i);
+        __m128 force = (terms & SIMD_FORCE_LANES) ? _mm_loadu_ps(forces + i) : _mm_setzero_ps();
+        if (terms & SIMD_FORCE_GRAVITY) { force = _mm_add_ps(force, _mm_mul_ps(mass, gravity)); }
+        if (terms & SIMD_FORCE_DRAG) { force = _mm_add_ps(force, _mm_mul_ps(v, drag)); }
+
+        const __m128 stepScale = _mm_mul_ps(dt, _mm_div_ps(one, mass));
+        const __m128 velocity = _mm_add_ps(v, _mm_mul_ps(force, stepScale));
+        const __m128 position = _mm_loadu_ps(positions + i);
+        _mm_storeu_ps(velocities + i, velocity);
+        _mm_storeu_ps(previous + i, position);
+        _mm_storeu_ps(positions + i, _mm_add_ps(position, _mm_mul_ps(velocity, dt)));
+    }
+    IntegrateForcesScalarBody_(args, i, terms, isInterleaved);
+}
+
+SIMD_INTEGRATE_VARIANTS_(Sse2, , IntegrateForcesSse2Body_)
+
+SIMD_INLINE void SumGravityDragSse2Body_(float *forces, const SimdIntegrateArgs *args, bool isInterleaved)
+{
+    const float *velocities = args->velocities, *masses = args->masses;
+    const size_t laneCount = args->laneCount;
+    const __m128 drag = _mm_set1_ps(args->drag);
+    const __m128 gravity = _mm_setr_ps(args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd);
+    size_t i = 0;
+    for (; i + 4 <= laneCount; i += 4)
+    {
+        __m128 mass;
+        if (isInterleaved)
+        {
+            const __m128 pair = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(masses + (i >> 1)));
+            mass = _mm_unpacklo_ps(pair, pair);
+        }
+        else { mass = _mm_loadu_ps(masses + i); }
+
+        const __m128 force = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(mass, gravity));
+        _mm_storeu_ps(forces + i, _mm_add_ps(force, _mm_mul_ps(_mm_loadu_ps(velocities + i), drag)));
+    }
+    SumGravityDragScalarBody_(forces, args, i, isInterleaved);
+}
+
+static void SumGravityDragSse2_(float *forces, const SimdIntegrateArgs *args)
+{
+    if (args->isInterleaved) { SumGravityDragSse2Body_(forces, args, true); }
+    else { SumGravityDragSse2Body_(forces, args, false); }
+}
+#endif
+
+#if defined(SIMD_AVX2)
+SIMD_TARGET_AVX2 SIMD_INLINE void IntegrateForcesAvx2Body_(const SimdIntegrateArgs *args, unsigned terms, bool isInterleaved)
+{
+    float *velocities = args->velocities, *positions = args->positions, *previous = args->previous;
+    const float *masses = args->masses, *forces = args->forces;
+    const size_t laneCount = args->laneCount;
+    const __m256 one = _mm256_set1_ps(1.0f), dt = _mm256_set1_ps(args->deltaTime), drag = _mm256_set1_ps(args->drag);
+    const __m256 gravity = _mm256_setr_ps(args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd,
+        args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd);
+    const __m256i pairs = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    size_t i = 0;
+    for (; i + 8 <= laneCount; i += 8)
+    {
+        __m256 mass;
+        if (isInterleaved) { mass = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(masses + (i >> 1))), pairs); }
+        else { mass = _mm256_loadu_ps(masses + i); }
+
+        const __m256 v = _mm256_loadu_ps(velocities + i);
+        __m256 force = (terms & SIMD_FORCE_LANES) ? _mm256_loadu_ps(forces + i) : _mm256_setzero_ps();
+        if (terms & SIMD_FORCE_GRAVITY) { force = _mm256_add_ps(force, _mm256_mul_ps(mass, gravity)); }
+        if (terms & SIMD_FORCE_DRAG) { force = _mm256_add_ps(force, _mm256_mul_ps(v, drag)); }
+
+        const __m256 stepScale = _mm256_mul_ps(dt, _mm256_div_ps(one, mass));
+        const __m256 velocity = _mm256_add_ps(v, _mm256_mul_ps(force, stepScale));
+        const __m256 position = _mm256_loadu_ps(positions + i);
+        _mm256_storeu_ps(velocities + i, velocity);
+        _mm256_storeu_ps(previous + i, position);
+        _mm256_storeu_ps(positions + i, _mm256_add_ps(position, _mm256_mul_ps(velocity, dt)));
+    }
+    IntegrateForcesScalarBody_(args, i, terms, isInterleaved);
+}
+
+SIMD_INTEGRATE_VARIANTS_(Avx2, SIMD_TARGET_AVX2, IntegrateForcesAvx2Body_)
+
+SIMD_TARGET_AVX2 SIMD_INLINE void SumGravityDragAvx2Body_(float *forces, const SimdIntegrateArgs *args, bool isInterleaved)
+{
+    const float *velocities = args->velocities, *masses = args->masses;
+    const size_t laneCount = args->laneCount;
+    const __m256 drag = _mm256_set1_ps(args->drag);
+    const __m256 gravity = _mm256_setr_ps(args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd,
+        args->gravityEven, args->gravityOdd, args->gravityEven, args->gravityOdd);
+    const __m256i pairs = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    size_t i = 0;
+    for (; i + 8 <= laneCount; i += 8)
+    {
+        __m256 mass;
+        if (isInterleaved) { mass = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(masses + (i >> 1))), pairs); }
+        else { mass = _mm256_loadu_ps(masses + i); }
+
+        const __m256 force = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(mass, gravity));
+        _mm256_storeu_ps(forces + i, _mm256_add_ps(force, _mm256_mul_ps(_mm256_loadu_ps(velocities + i), drag)));
+    }
+    SumGravityDragScalarBody_(forces, args, i, isInterleaved);
+}
+
+SIMD_TARGET_AVX2 static void SumGravityDragAvx2_(float *forces, const SimdIntegrateArgs *args)
+{
+    if (args->isInterleaved) { SumGravityDragAvx2Body_(forces, args, true); }
+    else { SumGravityDragAvx2Body_(forces, args, false); }
+}
+#endif
+
+static const SimdKernels scalarKernels_ = {
+    SIMD_LEVEL_SCALAR,
+    AddScalarScalar_,
+    AccumulateProductScalar_,
+    InverseScaleScalar_,
+    DuplicateScalar_,
+    IntegrateEulerScalar_,
+    ScaledDifferenceScalar_,
+    DivideScalar_,
+    AreFiniteScalar_,
+    SIMD_INTEGRATE_TABLE_(Scalar),
+    SumGravityDragScalar_,
+};
+
+#if defined(SIMD_SSE2)
+static const SimdKernels sse2Kernels_ = {
+    SIMD_LEVEL_SSE2,
+    AddScalarSse2_,
+    AccumulateProductSse2_,
+    InverseScaleSse2_,
+    DuplicateSse2_,
+    IntegrateEulerSse2_,
+    ScaledDifferenceSse2_,
+    DivideSse2_,
+    AreFiniteSse2_,
+    SIMD_INTEGRATE_TABLE_(Sse2),
+    SumGravityDragSse2_,
+};
+#endif
+
+#if defined(SIMD_AVX2)
+static const SimdKernels avx2Kernels_ = {
+    SIMD_LEVEL_AVX2,
+    AddScalarAvx2_,
+    AccumulateProductAvx2_,
+    InverseScaleAvx2_,
+    DuplicateAvx2_,
+    IntegrateEulerAvx2_,
+    ScaledDifferenceAvx2_,
+    DivideAvx2_,
+    AreFiniteAvx2_,
+    SIMD_INTEGRATE_TABLE_(Avx2),
+    SumGravityDragAvx2_,
+};
+#endif
+
+// Selected on first use. Threads racing there store the same table.
+static const SimdKernels *_Atomic activeKernels_ = NULL;
+
+static SimdLevel DetectSimdLevel_()
+{
+#if defined(SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return SIMD_LEVEL_AVX2; }
+#elif defined(SIMD_AVX2) && defined(_MSC_VER)
+    // AVX2 needs the CPU flag and an OS that saves the ymm registers
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        const bool hasAvx = (info[2] & (1 << 28)) != 0;
+        const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+        __cpuidex(info, 7, 0);
+        const bool hasAvx2 = (info[1] & (1 << 5)) != 0;
+        if (hasAvx && hasOsxsave && hasAvx2 && (_xgetbv(0) & 0x6) == 0x6) { return SIMD_LEVEL_AVX2; }
+    }
+#endif
+
+#if defined(SIMD_SSE2)
+    return SIMD_LEVEL_SSE2;
+#else
+    return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+// Scalar kernels
+// -----------------
+// Reference versions and the tails of the vector ones. Every operation is a
+// single rounded IEEE operation in the same order as the vector lanes.
+
+static void AddScalarScalar_(float *values, float scalar, size_t count)
+{
+    for (size_t i = 0; i < count; i++) { values[i] += scalar; }
+}
+
+static void AccumulateProductScalar_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count)
+{
+    for (size_t i = 0; i < count; i++) { out[i] += values[i] * ((i & 1) ? scaleOdd : scaleEven); }
+}
+
+static void InverseScaleScalar_(float *out, const float *values, float scale, size_t count)
+{
+    for (size_t i = 0; i < count; i++) { out[i] = scale * (1.0f / values[i]); }
+}
+
+static void DuplicateScalar_(float *out, const float *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[2 * i] = values[i];
+        out[2 * i + 1] = values[i];
+    }
+}
+
+static void IntegrateEulerScalar_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float velocity = velocities[i] + forces[i] * stepScales[i];
+        const float position = positions[i];
+        velocities[i] = velocity;
+        previous[i] = position;
+        positions[i] = position + velocity * deltaTime;
+    }
+}
+
+static void ScaledDifferenceScalar_(float *out, const float *a, const float *b, float scale, size_t count)
+{
+    for (size_t i = 0; i < count; i++) { out[i] = (a[i] - b[i]) * scale; }
+}
+
+static void DivideScalar_(float *out, const float *a, const float *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++) { out[i] = a[i] / b[i]; }
+}
+
+static bool AreFiniteScalar_(const float *values, size_t count)
+{
+    // All exponent bits set is an infinity or a NaN
+    uint32_t nonFinite = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        nonFinite |= ((bits & 0x7F800000u) == 0x7F800000u);
+    }
+    return !nonFinite;
+}
+
+// SSE2 kernels
+// -----------------
+
+#if defined(SIMD_SSE2)
+static void AddScalarSse2_(float *values, float scalar, size_t count)
+{
+    const __m128 s = _mm_set1_ps(scalar);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) { _mm_storeu_ps(values + i, _mm_add_ps(_mm_loadu_ps(values + i), s)); }
+    AddScalarScalar_(values + i, scalar, count - i);
+}
+
+static void AccumulateProductSse2_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count)
+{
+    const __m128 s = _mm_setr_ps(scaleEven, scaleOdd, scaleEven, scaleOdd);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(values + i), s)));
+    }
+    AccumulateProductScalar_(out + i, values + i, scaleEven, scaleOdd, count - i);
+}
+
+static void InverseScaleSse2_(float *out, const float *values, float scale, size_t count)
+{
+    const __m128 one = _mm_set1_ps(1.0f), s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(s, _mm_div_ps(one, _mm_loadu_ps(values + i))));
+    }
+    InverseScaleScalar_(out + i, values + i, scale, count - i);
+}
+
+static void DuplicateSse2_(float *out, const float *values, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps(values + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(v, v));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(v, v));
+    }
+    DuplicateScalar_(out + 2 * i, values + i, count - i);
+}
+
+static void IntegrateEulerSse2_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count)
+{
+    const __m128 dt = _mm_set1_ps(deltaTime);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 velocity = _mm_add_ps(_mm_loadu_ps(velocities + i),
+            _mm_mul_ps(_mm_loadu_ps(forces + i), _mm_loadu_ps(stepScales + i)));
+        const __m128 position = _mm_loadu_ps(positions + i);
+        _mm_storeu_ps(velocities + i, velocity);
+        _mm_storeu_ps(previous + i, position);
+        _mm_storeu_ps(positions + i, _mm_add_ps(position, _mm_mul_ps(velocity, dt)));
+    }
+    IntegrateEulerScalar_(velocities + i, positions + i, previous + i, forces + i, stepScales + i, deltaTime, count - i);
+}
+
+static void ScaledDifferenceSse2_(float *out, const float *a, const float *b, float scale, size_t count)
+{
+    const __m128 s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), s));
+    }
+    ScaledDifferenceScalar_(out + i, a + i, b + i, scale, count - i);
+}
+
+static void DivideSse2_(float *out, const float *a, const float *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) { _mm_storeu_ps(out + i, _mm_div_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))); }
+    DivideScalar_(out + i, a + i, b + i, count - i);
+}
+
+static bool AreFiniteSse2_(const float *values, size_t count)
+{
+    const __m128i exponent = _mm_set1_epi32(0x7F800000);
+    __m128i nonFinite = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i bits = _mm_castps_si128(_mm_loadu_ps(values + i));
+        nonFinite = _mm_or_si128(nonFinite, _mm_cmpeq_epi32(_mm_and_si128(bits, exponent), exponent));
+    }
+    return (_mm_movemask_epi8(nonFinite) == 0) && AreFiniteScalar_(values + i, count - i);
+}
+#endif
+
+// AVX2 kernels
+// -----------------
+// Same operations eight lanes wide. Products and sums stay separate, an FMA
+// would round once and change results against the other levels.
+
+#if defined(SIMD_AVX2)
+SIMD_TARGET_AVX2 static void AddScalarAvx2_(float *values, float scalar, size_t count)
+{
+    const __m256 s = _mm256_set1_ps(scalar);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) { _mm256_storeu_ps(values + i, _mm256_add_ps(_mm256_loadu_ps(values + i), s)); }
+    AddScalarScalar_(values + i, scalar, count - i);
+}
+
+SIMD_TARGET_AVX2 static void AccumulateProductAvx2_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count)
+{
+    const __m256 s = _mm256_setr_ps(scaleEven, scaleOdd, scaleEven, scaleOdd, scaleEven, scaleOdd, scaleEven, scaleOdd);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(values + i), s)));
+    }
+    AccumulateProductScalar_(out + i, values + i, scaleEven, scaleOdd, count - i);
+}
+
+SIMD_TARGET_AVX2 static void InverseScaleAvx2_(float *out, const float *values, float scale, size_t count)
+{
+    const __m256 one = _mm256_set1_ps(1.0f), s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(s, _mm256_div_ps(one, _mm256_loadu_ps(values + i))));
+    }
+    InverseScaleScalar_(out + i, values + i, scale, count - i);
+}
+
+SIMD_TARGET_AVX2 static void DuplicateAvx2_(float *out, const float *values, size_t count)
+{
+    const __m256i low = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i high = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 v = _mm256_loadu_ps(values + i);
+        _mm256_storeu_ps(out + 2 * i, _mm256_permutevar8x32_ps(v, low));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permutevar8x32_ps(v, high));
+    }
+    DuplicateScalar_(out + 2 * i, values + i, count - i);
+}
+
+SIMD_TARGET_AVX2 static void IntegrateEulerAvx2_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count)
+{
+    const __m256 dt = _mm256_set1_ps(deltaTime);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 velocity = _mm256_add_ps(_mm256_loadu_ps(velocities + i),
+            _mm256_mul_ps(_mm256_loadu_ps(forces + i), _mm256_loadu_ps(stepScales + i)));
+        const __m256 position = _mm256_loadu_ps(positions + i);
+        _mm256_storeu_ps(velocities + i, velocity);
+        _mm256_storeu_ps(previous + i, position);
+        _mm256_storeu_ps(positions + i, _mm256_add_ps(position, _mm256_mul_ps(velocity, dt)));
+    }
+    IntegrateEulerScalar_(velocities + i, positions + i, previous + i, forces + i, stepScales + i, deltaTime, count - i);
+}
+
+SIMD_TARGET_AVX2 static void ScaledDifferenceAvx2_(float *out, const float *a, const float *b, float scale, size_t count)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), s));
+    }
+    ScaledDifferenceScalar_(out + i, a + i, b + i, scale, count - i);
+}
+
+SIMD_TARGET_AVX2 static void DivideAvx2_(float *out, const float *a, const float *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    DivideScalar_(out + i, a + i, b + i, count - i);
+}
+
+SIMD_TARGET_AVX2 static bool AreFiniteAvx2_(const float *values, size_t count)
+{
+    const __m256i exponent = _mm256_set1_epi32(0x7F800000);
+    __m256i nonFinite = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i bits = _mm256_castps_si256(_mm256_loadu_ps(values + i));
+        nonFinite = _mm256_or_si256(nonFinite, _mm256_cmpeq_epi32(_mm256_and_si256(bits, exponent), exponent));
+    }
+    return _mm256_testz_si256(nonFinite, nonFinite) && AreFiniteScalar_(values + i, count - i);
+}
+#endif
+
+static const SimdKernels* KernelsForLevel_(SimdLevel level)
+{
+    switch (level)
+    {
+#if defined(SIMD_AVX2)
+    case SIMD_LEVEL_AVX2: return &avx2Kernels_;
+#endif
+#if defined(SIMD_SSE2)
+    case SIMD_LEVEL_SSE2: return &sse2Kernels_;
+#endif
+    default: return &scalarKernels_;
+    }
+}
+
+const SimdKernels* GetSimdKernels()
+{
+    const SimdKernels *kernels = atomic_load_explicit(&activeKernels_, memory_order_acquire);
+    if (kernels) { return kernels; }
+
+    kernels = KernelsForLevel_(GetSupportedSimdLevel());
+    atomic_store_explicit(&activeKernels_, kernels, memory_order_release);
+    return kernels;
+}
+
+SimdLevel GetSupportedSimdLevel()
+{
+    return DetectSimdLevel_();
+}
+
+SimdLevel SetSimdLevel(SimdLevel level)
+{
+    const SimdLevel supported = GetSupportedSimdLevel();
+    const SimdKernels *kernels = KernelsForLevel_(level < supported ? level : supported);
+    atomic_store_explicit(&activeKernels_, kernels, memory_order_release);
+    return kernels->level;
+}
+
+SimdLevel FindSimdLevel(const char *name)
+{
+    for (int level = 0; level < SIMD_LEVEL_COUNT; level++)
+    {
+        if (strcmp(name, simdLevelNames[level]) == 0) { return (SimdLevel)level; }
+    }
+    return SIMD_LEVEL_COUNT;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SIMD_SSE2
+    #if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+        #define SIMD_AVX2       // compiled everywhere SSE2 is, used only when the CPU has it
+    #endif
+#endif
+
+#if defined(SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define SIMD_TARGET_AVX2
+#endif
+
+// SIMD kernels
+// -----------------
+// Streaming kernels over float arrays, used by the per particle passes. A
+// vector attribute is either one interleaved stream (x0, y0, x1, y1, ...) or
+// one planar stream per component, so kernels that scale by a constant take
+// one factor for even and one for odd lanes. Interleaved streams must start
+// on an x lane. Every kernel has a scalar, an SSE2 and an AVX2 version with
+// bit-identical results, the widest one the CPU runs is picked on first use.
+typedef enum SimdLevel
+{
+    SIMD_LEVEL_SCALAR,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2,
+    SIMD_LEVEL_COUNT,
+}SimdLevel;
+
+// Terms of the fused integrate kernels. The force starts from the precomputed
+// lanes or from zero, then gravity and drag are added in that order.
+typedef enum SimdForceTerm
+{
+    SIMD_FORCE_LANES = 1 << 0,      // forces[i]
+    SIMD_FORCE_GRAVITY = 1 << 1,    // mass * (even lane ? gravityEven : gravityOdd)
+    SIMD_FORCE_DRAG = 1 << 2,       // velocities[i] * drag
+    SIMD_FORCE_TERM_COMBINATIONS = 1 << 3,
+}SimdForceTerm;
+
+typedef struct SimdIntegrateArgs
+{
+    float *velocities, *positions, *previous;
+    const float *masses;            // one per particle, each covers two lanes of an interleaved stream
+    const float *forces;            // SIMD_FORCE_LANES
+    size_t laneCount;
+    bool isInterleaved;
+    float gravityEven, gravityOdd;  // SIMD_FORCE_GRAVITY
+    float drag;                     // SIMD_FORCE_DRAG
+    float deltaTime;
+}SimdIntegrateArgs;
+
+typedef void (*SimdIntegrateFn)(const SimdIntegrateArgs *args);
+
+typedef struct SimdKernels
+{
+    SimdLevel level;
+
+    // values[i] += scalar
+    void (*AddScalar)(float *values, float scalar, size_t count);
+    // out[i] += values[i] * (even lane ? scaleEven : scaleOdd)
+    void (*AccumulateProduct)(float *out, const float *values, float scaleEven, float scaleOdd, size_t count);
+    // out[i] = scale * (1 / values[i])
+    void (*InverseScale)(float *out, const float *values, float scale, size_t count);
+    // out[2i] = out[2i + 1] = values[i], widens per particle scalars to interleaved lanes
+    void (*Duplicate)(float *out, const float *values, size_t count);
+    // Semi-implicit Euler: velocities += forces * stepScales, previous = positions,
+    // positions += velocities * deltaTime
+    void (*IntegrateEuler)(float *velocities, float *positions, float *previous, const float *forces,
+        const float *stepScales, float deltaTime, size_t count);
+    // out[i] = (a[i] - b[i]) * scale
+    void (*ScaledDifference)(float *out, const float *a, const float *b, float scale, size_t count);
+    // out[i] = a[i] / b[i]
+    void (*Divide)(float *out, const float *a, const float *b, size_t count);
+    // false if any value is an infinity or a NaN
+    bool (*AreFinite)(const float *values, size_t count);
+
+    // Semi-implicit Euler with the force and the step scale computed in the
+    // same pass, one variant per SimdForceTerm mask. Results match summing the
+    // terms into a lane buffer and running IntegrateEuler.
+    SimdIntegrateFn IntegrateForces[SIMD_FORCE_TERM_COMBINATIONS];
+    // forces[i] = 0 + gravity term + drag term of args, the start lanes for
+    // forces that are added per particle before IntegrateForces
+    void (*SumGravityDrag)(float *forces, const SimdIntegrateArgs *args);
+}SimdKernels;
+
+#if defined(_MSC_VER)
+    #define SIMD_INLINE static __forceinline
+#else
+    #define SIMD_INLINE static inline __attribute__((always_inline))
+#endif
+
+// declare extern variables
+// -----------------
+extern const char *simdLevelNames[SIMD_LEVEL_COUNT];
+
+// Private methods
+// -----------------
+static SimdLevel DetectSimdLevel_();
+static const SimdKernels* KernelsForLevel_(SimdLevel level);    // widest compiled level not above level
+
+static void AddScalarScalar_(float *values, float scalar, size_t count);
+static void AccumulateProductScalar_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count);
+static void InverseScaleScalar_(float *out, const float *values, float scale, size_t count);
+static void DuplicateScalar_(float *out, const float *values, size_t count);
+static void IntegrateEulerScalar_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count);
+static void ScaledDifferenceScalar_(float *out, const float *a, const float *b, float scale, size_t count);
+static void DivideScalar_(float *out, const float *a, const float *b, size_t count);
+static bool AreFiniteScalar_(const float *values, size_t count);
+
+// Bodies of the IntegrateForces<terms><level>_ variants generated in simd.c,
+// terms and isInterleaved are constants in every instantiation
+SIMD_INLINE void IntegrateForcesScalarBody_(const SimdIntegrateArgs *args, size_t begin, unsigned terms, bool isInterleaved);
+SIMD_INLINE void SumGravityDragScalarBody_(float *forces, const SimdIntegrateArgs *args, size_t begin, bool isInterleaved);
+static void SumGravityDragScalar_(float *forces, const SimdIntegrateArgs *args);
+
+#if defined(SIMD_SSE2)
+static void AddScalarSse2_(float *values, float scalar, size_t count);
+static void AccumulateProductSse2_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count);
+static void InverseScaleSse2_(float *out, const float *values, float scale, size_t count);
+static void DuplicateSse2_(float *out, const float *values, size_t count);
+static void IntegrateEulerSse2_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count);
+static void ScaledDifferenceSse2_(float *out, const float *a, const float *b, float scale, size_t count);
+static void DivideSse2_(float *out, const float *a, const float *b, size_t count);
+static bool AreFiniteSse2_(const float *values, size_t count);
+SIMD_INLINE void IntegrateForcesSse2Body_(const SimdIntegrateArgs *args, unsigned terms, bool isInterleaved);
+SIMD_INLINE void SumGravityDragSse2Body_(float *forces, const SimdIntegrateArgs *args, bool isInterleaved);
+static void SumGravityDragSse2_(float *forces, const SimdIntegrateArgs *args);
+#endif
+
+#if defined(SIMD_AVX2)
+SIMD_TARGET_AVX2 static void AddScalarAvx2_(float *values, float scalar, size_t count);
+SIMD_TARGET_AVX2 static void AccumulateProductAvx2_(float *out, const float *values, float scaleEven, float scaleOdd, size_t count);
+SIMD_TARGET_AVX2 static void InverseScaleAvx2_(float *out, const float *values, float scale, size_t count);
+SIMD_TARGET_AVX2 static void DuplicateAvx2_(float *out, const float *values, size_t count);
+SIMD_TARGET_AVX2 static void IntegrateEulerAvx2_(float *velocities, float *positions, float *previous, const float *forces,
+    const float *stepScales, float deltaTime, size_t count);
+SIMD_TARGET_AVX2 static void ScaledDifferenceAvx2_(float *out, const float *a, const float *b, float scale, size_t count);
+SIMD_TARGET_AVX2 static void DivideAvx2_(float *out, const float *a, const float *b, size_t count);
+SIMD_TARGET_AVX2 static bool AreFiniteAvx2_(const float *values, size_t count);
+SIMD_TARGET_AVX2 SIMD_INLINE void IntegrateForcesAvx2Body_(const SimdIntegrateArgs *args, unsigned terms, bool isInterleaved);
+SIMD_TARGET_AVX2 SIMD_INLINE void SumGravityDragAvx2Body_(float *forces, const SimdIntegrateArgs *args, bool isInterleaved);
+SIMD_TARGET_AVX2 static void SumGravityDragAvx2_(float *forces, const SimdIntegrateArgs *args);
+#endif
+
+// Interface methods
+// -----------------
+const SimdKernels* GetSimdKernels();        // kernels of the active level
+SimdLevel GetSupportedSimdLevel();          // widest level this CPU runs
+SimdLevel SetSimdLevel(SimdLevel level);    // clamped to the supported level, returns the level in use
+SimdLevel FindSimdLevel(const char *name);  // SIMD_LEVEL_COUNT for unknown names
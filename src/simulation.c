@@ -0,0 +1,250 @@
+#include "pch.h"
+#include "simulation.h"
+
+#include "domain.h"
+
+FixedTimestep InitFixedTimestep(float stepRate, int maxSteps)
+{
+    PASSERT(stepRate > EPSILON, LOG_ERROR, "Fixed timestep rate must be greater than zero.");
+    PASSERT(maxSteps > 0, LOG_WARNING, "Fixed timestep max steps must be at least 1.");
+
+    FixedTimestep clock = { 0 };
+    clock.timestep = 1.0 / (double)stepRate;
+    clock.maxSteps = (maxSteps > 0) ? maxSteps : 1;
+    return clock;
+}
+
+int AdvanceFixedTimestep(FixedTimestep *this, double elapsed)
+{
+    this->accumulator += (elapsed > 0.0) ? elapsed : 0.0;
+
+    int steps = (int)(this->accumulator / this->timestep);
+    if (steps > this->maxSteps)
+    {
+        this->droppedSteps += (uint64_t)(steps - this->maxSteps);
+        steps = this->maxSteps;
+        this->accumulator = fmod(this->accumulator, this->timestep);
+    }
+    else
+    {
+        this->accumulator -= steps * this->timestep;
+    }
+    return steps;
+}
+
+static void ExecuteSimulationCommands_(SimulationThread *this)
+{
+    ParticleSystem *system = this->system;
+
+    uint32_t tail = atomic_load_explicit(&this->commandTail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&this->commandHead, memory_order_acquire);
+    for (; tail != head; tail++)
+    {
+        const SimulationCommand *command = &this->commands[tail % SIMULATION_COMMAND_CAPACITY];
+        switch (command->type)
+        {
+        case SIM_COMMAND_EMIT:
+        {
+            const Vector2 pos = Vector2Add(command->position,
+                Vector2Scale((Vector2){ NextRandomF(&system->randomState), NextRandomF(&system->randomState) }, system->emitter.radius));
+            EmitParticle(system, pos, &defaultParticleProps);
+            break;
+        }
+        case SIM_COMMAND_MOVE_EMITTER:
+            system->emitter.position = command->position;
+            break;
+        case SIM_COMMAND_TOGGLE_COLLISION_FIELD:
+            if (system->collisionMode == COLLISION_MODE_FIELD) { system->collisionMode = COLLISION_MODE_GEOMETRY; }
+            else if (!system->collisionField) { BakeCollisionField(system, PARTICLE_RADIUS); }
+            else { system->collisionMode = COLLISION_MODE_FIELD; }
+            break;
+        case SIM_COMMAND_TOGGLE_WALL_HANDLER:
+            system->wallHandler = (system->wallHandler == WALL_HANDLER_CLAMP) ?
+                WALL_HANDLER_HASH_QUERY : WALL_HANDLER_CLAMP;
+            break;
+        case SIM_COMMAND_TOGGLE_DOMAIN_DECOMPOSITION:
+            SetDomainDecomposition(system, system->domain ? 0 : DOMAIN_TILE_COUNT);
+            break;
+        case SIM_COMMAND_TOGGLE_HASH_DIAGNOSTICS:
+            SetHashDiagnostics(system, !system->isMeasuringHash);
+            break;
+        default:
+            break;
+        }
+    }
+    atomic_store_explicit(&this->commandTail, tail, memory_order_release);
+}
+
+static void PublishRenderSnapshot_(SimulationThread *this, double stepTime)
+{
+    const ParticleSystem *system = this->system;
+    RenderSnapshot *snapshot = &this->snapshots[this->backIndex];
+
+    snapshot->step = this->stepCount;
+    snapshot->activeCount = system->particles_->activeCount;
+
+    // Pack straight into the upload format, bucketed by culling cell, so the
+    // render thread copies only the visible part of the pool into the instance
+    // buffer. The bounds leave room for
+    // particles pushed slightly past the boundary box.
+    const float margin = 2.0f * PARTICLE_RADIUS;
+    snapshot->instanceBounds = (Rectangle){
+        system->boundaryBox.left - margin, system->boundaryBox.top - margin,
+        (float)(system->boundaryBox.right - system->boundaryBox.left) + (2.0f * margin),
+        (float)(system->boundaryBox.bottom - system->boundaryBox.top) + (2.0f * margin) };
+    snapshot->stats = system->stats;
+    PROFILE_SCOPE(snapshot->stats.phaseTimes, PROFILE_PHASE_PACK)
+    {
+        PackParticleInstances(snapshot->instances, &snapshot->grid, snapshot->instanceBounds, system->particles_);
+    }
+
+    snapshot->emitterPosition = system->emitter.position;
+    snapshot->emitterRadius = system->emitter.radius;
+    snapshot->collisionMode = system->collisionMode;
+    snapshot->wallHandler = system->wallHandler;
+    snapshot->domainTileCount = system->domain ? system->domain->tileCount : 0;
+
+    snapshot->forceCount = arrlenu(system->forces_);
+    PASSERT(snapshot->forceCount <= MAX_SNAPSHOT_FORCES, LOG_WARNING, "Too many forces for the render snapshot. Drawing the first %d.", MAX_SNAPSHOT_FORCES);
+    if (snapshot->forceCount > MAX_SNAPSHOT_FORCES) { snapshot->forceCount = MAX_SNAPSHOT_FORCES; }
+    memcpy(snapshot->forces, system->forces_, sizeof(Force) * snapshot->forceCount);
+
+    snapshot->colliderCount = arrlenu(system->colliders->colliders);
+    PASSERT(snapshot->colliderCount <= MAX_SNAPSHOT_COLLIDERS, LOG_WARNING, "Too many colliders for the render snapshot. Drawing the first %d.", MAX_SNAPSHOT_COLLIDERS);
+    if (snapshot->colliderCount > MAX_SNAPSHOT_COLLIDERS) { snapshot->colliderCount = MAX_SNAPSHOT_COLLIDERS; }
+    memcpy(snapshot->colliders, system->colliders->colliders, sizeof(Collider) * snapshot->colliderCount);
+
+    // The domain solver fills tile hashes instead, the global one goes stale
+    snapshot->isMeasuringHash = system->isMeasuringHash && !system->domain;
+    if (snapshot->isMeasuringHash)
+    {
+        snapshot->hashSpacing = system->spatialHash->spacing;
+        snapshot->hashTableSize = system->spatialHash->tableSize;
+        memcpy(snapshot->hashSlotCounts, system->spatialHash->cellCount, sizeof(uint32_t) * system->spatialHash->tableSize);
+    }
+    snapshot->stepTime = stepTime;
+    snapshot->droppedSteps = this->clock.droppedSteps;
+    snapshot->timestep = this->clock.timestep;
+    snapshot->publishTime = GetPlatformTime();
+
+    // Hand the back buffer over and take whichever buffer was in the middle
+    const uint32_t previous = atomic_exchange_explicit(&this->middle,
+        this->backIndex | SNAPSHOT_FRESH, memory_order_acq_rel);
+    this->backIndex = previous & ~SNAPSHOT_FRESH;
+}
+
+static void SimulationMain_(void *argument)
+{
+    SimulationThread *this = (SimulationThread*)argument;
+#if defined(PARTICLE_PROFILE)
+    SetTraceThreadName("simulation");
+#endif
+
+    double previousTime = GetPlatformTime();
+    while (atomic_load_explicit(&this->isRunning, memory_order_acquire))
+    {
+        ExecuteSimulationCommands_(this);
+
+        const double now = GetPlatformTime();
+        const int steps = AdvanceFixedTimestep(&this->clock, now - previousTime);
+        previousTime = now;
+
+        if (steps > 0)
+        {
+            const double stepStart = GetPlatformTime();
+            for (int i = 0; i < steps; i++)
+            {
+                TRACE_SCOPE("step")
+                {
+                    UpdateParticles(this->system, (float)this->clock.timestep);
+                }
+                this->stepCount++;
+            }
+            PublishRenderSnapshot_(this, (GetPlatformTime() - stepStart) / steps);
+        }
+
+        SleepPlatform(GetFixedTimestepDelay(&this->clock));
+    }
+}
+
+SimulationThread* ConstructSimulationThread(ParticleSystem *system, float stepRate)
+{
+    SimulationThread *simulation = (SimulationThread*)TrackedMalloc(MEMORY_TAG_SIMULATION, sizeof(SimulationThread));
+    PASSERT(simulation, LOG_FATAL, "Failed to allocate simulation thread");
+    if(!simulation) { return NULL; }
+
+    simulation->system = system;
+    simulation->clock = InitFixedTimestep(stepRate, SIMULATION_MAX_STEPS);
+    simulation->stepCount = 0;
+
+    atomic_init(&simulation->commandHead, 0);
+    atomic_init(&simulation->commandTail, 0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        simulation->snapshots[i].step = 0;
+        simulation->snapshots[i].activeCount = 0;
+    }
+    simulation->backIndex = 0;
+    simulation->frontIndex = 1;
+    atomic_init(&simulation->middle, 2);
+
+    // Render the initial state until the first step is published
+    PublishRenderSnapshot_(simulation, 0.0);
+    AcquireRenderSnapshot(simulation);
+
+    atomic_init(&simulation->isRunning, true);
+    if (!StartThread(&simulation->thread, SimulationMain_, simulation))
+    {
+        TraceLog(LOG_FATAL, "Failed to start simulation thread");
+        TrackedFree(simulation);
+        return NULL;
+    }
+
+    return simulation;
+}
+
+void DestructSimulationThread(SimulationThread *this)
+{
+    atomic_store_explicit(&this->isRunning, false, memory_order_release);
+    JoinThread(&this->thread);
+    TrackedFree(this);
+}
+
+bool PushSimulationCommand(SimulationThread *this, SimulationCommand command)
+{
+    const uint32_t head = atomic_load_explicit(&this->commandHead, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&this->commandTail, memory_order_acquire);
+    PASSERTRETURNVALUE((head - tail) < SIMULATION_COMMAND_CAPACITY, false, LOG_WARNING,
+        "Simulation command queue full. Dropping command.");
+
+    this->commands[head % SIMULATION_COMMAND_CAPACITY] = command;
+    atomic_store_explicit(&this->commandHead, head + 1, memory_order_release);
+    return true;
+}
+
+const RenderSnapshot* AcquireRenderSnapshot(SimulationThread *this)
+{
+    // Swap the front buffer with the middle one only when a newer snapshot was
+    // published, otherwise keep drawing the current front buffer.
+    if (atomic_load_explicit(&this->middle, memory_order_acquire) & SNAPSHOT_FRESH)
+    {
+        const uint32_t previous = atomic_exchange_explicit(&this->middle,
+            this->frontIndex, memory_order_acq_rel);
+        this->frontIndex = previous & ~SNAPSHOT_FRESH;
+    }
+    return &this->snapshots[this->frontIndex];
+}
+
+float GetRenderSnapshotAlpha(const RenderSnapshot *snapshot, double time)
+{
+    // The snapshot is drawn one step behind the simulation. Time since publish
+    // moves the interpolant from the previous step to the published one.
+    if (snapshot->timestep <= 0.0) { return 1.0f; }
+    return Clamp((float)((time - snapshot->publishTime) / snapshot->timestep), 0.0f, 1.0f);
+}
+
+void DrawRenderSnapshot(const RenderSnapshot *snapshot, ParticleRenderer *renderer, Camera2D camera, float alpha)
+{
+    DrawParticleInstances(renderer, snapshot->instances, &snapshot->grid, snapshot->instanceBounds, camera, alpha);
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <stdint.h>
+#include <stdatomic.h>
+#include "raylib.h"
+
+#include "particle.h"
+#include "collider.h"
+#include "platform.h"
+#include "renderer.h"
+
+#define SIMULATION_COMMAND_CAPACITY 256
+#define MAX_SNAPSHOT_FORCES 16
+#define MAX_SNAPSHOT_COLLIDERS 256
+
+// Fixed timestep
+// -----------------
+// Accumulates elapsed wall time and converts it into a whole number of fixed
+// steps. At most maxSteps are returned per advance, any remaining backlog is
+// dropped so a slow step cannot snowball into ever longer catch-up frames.
+typedef struct FixedTimestep
+{
+    double timestep;
+    double accumulator;
+    int maxSteps;
+    uint64_t droppedSteps;
+}FixedTimestep;
+
+// Commands
+// -----------------
+// Input is forwarded from the render thread to the simulation thread through a
+// single-producer single-consumer ring so the particle system has one owner.
+typedef enum SimulationCommandType
+{
+    SIM_COMMAND_EMIT,                       // emit one particle within the emitter radius
+    SIM_COMMAND_MOVE_EMITTER,
+    SIM_COMMAND_TOGGLE_COLLISION_FIELD,
+    SIM_COMMAND_TOGGLE_WALL_HANDLER,
+    SIM_COMMAND_TOGGLE_DOMAIN_DECOMPOSITION,
+    SIM_COMMAND_TOGGLE_HASH_DIAGNOSTICS,
+}SimulationCommandType;
+
+typedef struct SimulationCommand
+{
+    SimulationCommandType type;
+    Vector2 position;
+}SimulationCommand;
+
+// Snapshots
+// -----------------
+typedef struct RenderSnapshot
+{
+    uint64_t step;
+    size_t activeCount;
+    ParticleInstance instances[MAX_PARTICLE_COUNT];    // packed for upload, sorted by grid cell
+    ParticleRenderGrid grid;
+    Rectangle instanceBounds;
+
+    double publishTime; // platform time at which the snapshot was published
+    double timestep;
+
+    Vector2 emitterPosition;
+    float emitterRadius;
+    CollisionMode collisionMode;
+    WallHandler wallHandler;
+    uint32_t domainTileCount;   // 0 when the domain decomposition is disabled
+    ParticleSystemStats stats;
+
+    // Scene overlays, copied so the render thread never reads the system
+    Force forces[MAX_SNAPSHOT_FORCES];
+    size_t forceCount;
+    Collider colliders[MAX_SNAPSHOT_COLLIDERS];
+    size_t colliderCount;
+
+    // Slot occupancy of the global spatial hash, only while hash diagnostics are on
+    bool isMeasuringHash;
+    float hashSpacing;
+    uint32_t hashTableSize;
+    uint32_t hashSlotCounts[MAX_PARTICLE_COUNT];
+
+    double stepTime;    // seconds spent in the last UpdateParticles call
+    uint64_t droppedSteps;
+}RenderSnapshot;
+
+// Simulation thread
+// -----------------
+typedef struct SimulationThread
+{
+    ParticleSystem *system;
+    FixedTimestep clock;
+    uint64_t stepCount;
+
+    Thread thread;
+    _Atomic bool isRunning;
+
+    SimulationCommand commands[SIMULATION_COMMAND_CAPACITY];
+    _Atomic uint32_t commandHead;  // written by the render thread
+    _Atomic uint32_t commandTail;  // written by the simulation thread
+
+    // Triple buffer. The simulation thread owns backIndex, the render thread
+    // owns frontIndex and the two swap through the atomic middle slot. The
+    // SNAPSHOT_FRESH bit marks a middle buffer that has not been read yet.
+    RenderSnapshot snapshots[3];
+    uint32_t backIndex;
+    uint32_t frontIndex;
+    _Atomic uint32_t middle;
+}SimulationThread;
+
+#define SNAPSHOT_FRESH 0x4u
+
+// Private methods
+// -----------------
+static void ExecuteSimulationCommands_(SimulationThread *this);
+static void PublishRenderSnapshot_(SimulationThread *this, double stepTime);
+static void SimulationMain_(void *argument);
+
+// Interface methods
+// -----------------
+FixedTimestep InitFixedTimestep(float stepRate, int maxSteps);
+int AdvanceFixedTimestep(FixedTimestep *this, double elapsed);
+static inline double GetFixedTimestepDelay(const FixedTimestep *this) { return this->timestep - this->accumulator; }
+
+SimulationThread* ConstructSimulationThread(ParticleSystem *system, float stepRate);
+void DestructSimulationThread(SimulationThread *this);
+
+bool PushSimulationCommand(SimulationThread *this, SimulationCommand command);
+const RenderSnapshot* AcquireRenderSnapshot(SimulationThread *this);
+
+float GetRenderSnapshotAlpha(const RenderSnapshot *snapshot, double time);
+void DrawRenderSnapshot(const RenderSnapshot *snapshot, ParticleRenderer *renderer, Camera2D camera, float alpha);
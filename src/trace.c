@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "trace.h"
+
+#include <stdio.h>
+
+#if defined(PARTICLE_PROFILE)
+
+static Tracer tracer_ = { 0 };
+static TRACE_THREAD_LOCAL TraceBuffer *threadBuffer_ = NULL;
+static TRACE_THREAD_LOCAL char threadName_[32] = { 0 };
+static TRACE_THREAD_LOCAL bool isThreadUntraced_ = false;  // no buffer slot left for this thread
+
+static TraceBuffer* AcquireTraceBuffer_()
+{
+    if (threadBuffer_ || isThreadUntraced_) { return threadBuffer_; }
+
+    isThreadUntraced_ = true;
+    const uint32_t index = atomic_fetch_add_explicit(&tracer_.bufferCount, 1, memory_order_relaxed);
+    PASSERTRETURNVALUE(index < MAX_TRACE_THREADS, NULL, LOG_WARNING, "More than %d threads record trace events", MAX_TRACE_THREADS);
+
+    TraceBuffer *buffer = (TraceBuffer*)TrackedMalloc(MEMORY_TAG_TRACE, sizeof(TraceBuffer));
+    PASSERTRETURNVALUE(buffer, NULL, LOG_ERROR, "Failed to allocate trace buffer");
+    isThreadUntraced_ = false;
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    atomic_init(&buffer->droppedCount, 0);
+    if (threadName_[0]) { snprintf(buffer->threadName, sizeof(buffer->threadName), "%s", threadName_); }
+    else { snprintf(buffer->threadName, sizeof(buffer->threadName), "thread %u", index); }
+
+    // Publish after the buffer is initialized
+    atomic_store_explicit(&tracer_.buffers[index], buffer, memory_order_release);
+    threadBuffer_ = buffer;
+    return buffer;
+}
+
+void StartTrace()
+{
+    // Drop whatever was recorded before
+    const uint32_t count = atomic_load_explicit(&tracer_.bufferCount, memory_order_acquire);
+    for (uint32_t b = 0; b < count && b < MAX_TRACE_THREADS; b++)
+    {
+        TraceBuffer *buffer = atomic_load_explicit(&tracer_.buffers[b], memory_order_acquire);
+        if (!buffer) { continue; }
+        atomic_store_explicit(&buffer->tail, atomic_load_explicit(&buffer->head, memory_order_acquire), memory_order_release);
+    }
+
+    tracer_.epoch = GetPlatformTime();
+    atomic_store_explicit(&tracer_.isRecording, true, memory_order_release);
+    TraceLog(LOG_INFO, "TRACE: Recording");
+}
+
+void StopTrace()
+{
+    atomic_store_explicit(&tracer_.isRecording, false, memory_order_release);
+}
+
+bool IsTraceRecording()
+{
+    return atomic_load_explicit(&tracer_.isRecording, memory_order_relaxed);
+}
+
+bool FlushTrace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    PASSERTRETURNVALUE(file, false, LOG_WARNING, "Failed to open trace file %s", path);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool isFirst = true;
+    size_t eventCount = 0;
+    uint64_t droppedCount = 0;
+
+    const uint32_t count = atomic_load_explicit(&tracer_.bufferCount, memory_order_acquire);
+    for (uint32_t b = 0; b < count && b < MAX_TRACE_THREADS; b++)
+    {
+        TraceBuffer *buffer = atomic_load_explicit(&tracer_.buffers[b], memory_order_acquire);
+        if (!buffer) { continue; }
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            isFirst ? "" : ",\n", b, buffer->threadName);
+        isFirst = false;
+
+        const uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        const uint64_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+        for (uint64_t e = tail; e < head; e++)
+        {
+            const TraceEvent *event = &buffer->events[e & (TRACE_BUFFER_SIZE - 1)];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event->name, b, (event->start - tracer_.epoch) * 1.0e6, event->duration * 1.0e6);
+        }
+        eventCount += (size_t)(head - tail);
+        atomic_store_explicit(&buffer->tail, head, memory_order_release);
+        droppedCount += atomic_exchange_explicit(&buffer->droppedCount, 0, memory_order_relaxed);
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    TraceLog(LOG_INFO, "TRACE: Wrote %zu events to %s", eventCount, path);
+    PASSERT(droppedCount == 0, LOG_WARNING, "Trace buffers were full, %llu events dropped. Flush more often.",
+        (unsigned long long)droppedCount);
+    return true;
+}
+
+void ShutdownTrace()
+{
+    // Only valid once every recording thread has stopped
+    StopTrace();
+    const uint32_t count = atomic_load_explicit(&tracer_.bufferCount, memory_order_acquire);
+    for (uint32_t b = 0; b < count && b < MAX_TRACE_THREADS; b++)
+    {
+        TrackedFree(atomic_exchange_explicit(&tracer_.buffers[b], NULL, memory_order_acq_rel));
+    }
+    atomic_store_explicit(&tracer_.bufferCount, 0, memory_order_release);
+    threadBuffer_ = NULL;
+    isThreadUntraced_ = false;
+}
+
+void SetTraceThreadName(const char *name)
+{
+    snprintf(threadName_, sizeof(threadName_), "%s", name);
+}
+
+void RecordTraceEvent(const char *name, double start, double end)
+{
+    if (!atomic_load_explicit(&tracer_.isRecording, memory_order_relaxed)) { return; }
+
+    TraceBuffer *buffer = AcquireTraceBuffer_();
+    if (!buffer) { return; }
+
+    const uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    if ((head - atomic_load_explicit(&buffer->tail, memory_order_acquire)) >= TRACE_BUFFER_SIZE)
+    {
+        atomic_fetch_add_explicit(&buffer->droppedCount, 1, memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[head & (TRACE_BUFFER_SIZE - 1)] = (TraceEvent){ name, start, end - start };
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+#endif // PARTICLE_PROFILE
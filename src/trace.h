@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "config.h"
+#include "platform.h"
+
+#define MAX_TRACE_THREADS 64
+#define TRACE_BUFFER_SIZE 65536     // events per thread, power of two
+
+#if defined(_MSC_VER)
+    #define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+    #define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+// Trace events
+// -----------------
+// Complete events ("X" in the Chrome trace format) recorded into one buffer per
+// thread. A buffer is a single producer, single consumer ring: only its thread
+// appends, only FlushTrace consumes, so recording never takes a lock. Events
+// are dropped while a buffer is full.
+typedef struct TraceEvent
+{
+    const char *name;       // must outlive the trace, usually a string literal
+    double start;           // platform time in seconds
+    double duration;
+}TraceEvent;
+
+typedef struct TraceBuffer
+{
+    TraceEvent events[TRACE_BUFFER_SIZE];
+    _Atomic uint64_t head;          // advanced by the owning thread
+    _Atomic uint64_t tail;          // advanced by the flushing thread
+    _Atomic uint64_t droppedCount;
+    char threadName[32];
+}TraceBuffer;
+
+typedef struct Tracer
+{
+    _Atomic bool isRecording;
+    _Atomic uint32_t bufferCount;
+    TraceBuffer *_Atomic buffers[MAX_TRACE_THREADS];
+    double epoch;           // platform time of StartTrace, trace timestamps are relative to it
+}Tracer;
+
+// TRACE_SCOPE(name) { ... } records the block as one event while a trace is
+// being recorded. Compiled out together with the profiler timers.
+#if defined(PARTICLE_PROFILE)
+    #define TRACE_SCOPE(name) \
+        for (double traceStart_ = GetPlatformTime(), traceOnce_ = 1.0; traceOnce_ > 0.0; \
+            RecordTraceEvent((name), traceStart_, GetPlatformTime()), traceOnce_ = 0.0)
+#else
+    #define TRACE_SCOPE(name)
+#endif
+
+#if defined(PARTICLE_PROFILE)
+
+// Private methods
+// -----------------
+static TraceBuffer* AcquireTraceBuffer_();
+
+// Interface methods
+// -----------------
+void StartTrace();
+void StopTrace();
+bool IsTraceRecording();
+bool FlushTrace(const char *path);
+void ShutdownTrace();
+
+// Names the calling thread in the trace. Only takes effect before the thread
+// records its first event.
+void SetTraceThreadName(const char *name);
+void RecordTraceEvent(const char *name, double start, double end);
+
+#endif // PARTICLE_PROFILE